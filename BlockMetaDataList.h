@@ -0,0 +1,1489 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_BLOCKMETADATALIST_H
+#define MEMORY_UNIT_IMPLEMENTATION_BLOCKMETADATALIST_H
+
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <iostream>
+#include <sys/mman.h>
+#include "SmallocCounters.h"
+#include "SHeapStats.h"
+#include "SHeapSnapshot.h"
+#include "Mymalloc.h"
+
+/* Defaults for the BlockMetaDataList template parameters */
+#ifndef BIN_NUM
+#define BIN_NUM 128
+#endif
+#ifndef MMAP_BIN
+#define MMAP_BIN 128
+#endif
+#define COMBINED_LIST (-1)
+#define WILDERNESS combined_list_tail
+#define DISABLE_WILDERNESS_EXTEND 0
+#define ENABLE_WILDERNESS_EXTEND 1
+#define DONT_MERGE 0
+#define MERGE 1
+/* Dynamic mmap threshold (glibc style): requests bigger than the threshold are mmapped (MmapBin KB at start) */
+#define DEFAULT_MMAP_THRESHOLD ((size_t)(MMAP_BIN * 1e3))
+#define DEFAULT_MMAP_THRESHOLD_MAX ((size_t)(32 * 1024 * 1024))
+/* Page heap: requests above the mmap threshold and up to PAGE_HEAP_MAX are served as page runs out of big regions.
+ * Page heap frees cost no syscall, so they don't raise the dynamic threshold - with the defaults every request from
+ * 128KB to 4MB stays in the page heap and the threshold only moves for the mmapped blocks above 4MB */
+#define SPAN_PAGE_SIZE ((size_t)4096)
+#define DEFAULT_PAGE_HEAP_MAX ((size_t)(4 * 1024 * 1024))
+/* Regions are aligned to their size, so a span finds its region (and the region's page map) by masking its address */
+#define PAGE_HEAP_REGION_SIZE ((size_t)(64 * 1024 * 1024))
+#define PAGE_HEAP_REGION_PAGES (PAGE_HEAP_REGION_SIZE / SPAN_PAGE_SIZE)
+/* Free spans of up to PAGE_HEAP_LISTS - 2 pages have a list per length, longer ones share the last list */
+#define PAGE_HEAP_LISTS 1024
+/* Chunked heap growth: sbrk at least sbrk_chunk bytes (doubling after every growth up to SBRK_CHUNK_MAX), 0 - grow exactly */
+#define DEFAULT_SBRK_CHUNK ((size_t)0)
+#define SBRK_CHUNK_MAX ((size_t)(8 * 1024 * 1024))
+/* Heap backend (HEAP_BACKEND_SBRK / HEAP_BACKEND_RESERVED, see Mymalloc.h) */
+#ifndef DEFAULT_HEAP_BACKEND
+#define DEFAULT_HEAP_BACKEND HEAP_BACKEND_SBRK
+#endif
+#define RESERVED_HEAP_SIZE ((size_t)(16) * 1024 * 1024 * 1024)
+#define RESERVED_HEAP_COMMIT ((size_t)(1024 * 1024))
+/* Payload alignment malloc() callers expect - the heap starts on it, so payloads stay aligned while sizes are multiples of it */
+#define MALLOC_ALIGNMENT ((size_t)16)
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+/**
+ * This is a metadata used to manage the allocated blocks in a linked list
+ */
+struct MallocMetaData    {
+    size_t size;
+    bool is_free;
+    bool is_mmapped;
+    bool in_page_heap;
+    bool is_deferred;
+    MallocMetaData* next;
+    MallocMetaData* prev;
+    MallocMetaData* next_in_bin;
+    MallocMetaData* prev_in_bin;
+};
+
+/**
+ * A neighbour can be merged with if it is free and already in its bin (not waiting in the unsorted list)
+ */
+inline bool isMergeable(MallocMetaData *block) {
+    return block and block->is_free and not block->is_deferred;
+}
+
+inline bool checkMergeLeft(MallocMetaData *block, size_t new_size) {
+    return isMergeable(block->prev) and
+           (new_size <= block->prev->size + sizeof(MallocMetaData) + block->size);
+}
+inline bool checkMergeRight(MallocMetaData *block, size_t new_size) {
+    return isMergeable(block->next) and
+           (new_size <= block->next->size + sizeof(MallocMetaData) + block->size);
+}
+inline bool checkMergeBoth(MallocMetaData *block, size_t new_size) {
+    return isMergeable(block->next) and
+           isMergeable(block->prev) and
+           (new_size <= block->prev->size + block->next->size + 2* sizeof(MallocMetaData) + block->size);
+}
+/**
+ * This is the start of a page heap region: the span every page belongs to, kept up to date for the first and last
+ * page of each span (what coalescing looks at). The region's spans follow it.
+ */
+struct PageHeapRegion {
+    MallocMetaData* pagemap[PAGE_HEAP_REGION_PAGES];
+};
+#define PAGE_HEAP_HEADER_PAGES ((sizeof(PageHeapRegion) + SPAN_PAGE_SIZE - 1) / SPAN_PAGE_SIZE)
+/* Biggest span a region holds */
+#define PAGE_HEAP_MAX_SPAN ((PAGE_HEAP_REGION_PAGES - PAGE_HEAP_HEADER_PAGES) * SPAN_PAGE_SIZE)
+
+/**
+ * This is a page granular span allocator for mid-size blocks (like tcmalloc's page heap).
+ * Regions are reserved with a single mmap each and carved into runs of pages. Free spans (size = span bytes) sit in
+ * lists by length with a bitmap of the non-empty ones, and coalesce with their neighbours through the region's page map.
+ * A region that is entirely free again is unmapped, unless it is the last one.
+ */
+class PageHeap {
+public:
+    MallocMetaData* free_lists[PAGE_HEAP_LISTS] = {};
+    uint64_t nonempty_lists[PAGE_HEAP_LISTS / 64] = {};
+    size_t num_regions = 0;
+    MallocMetaData* allocateSpan(size_t bytes);
+    void freeSpan(MallocMetaData* span, size_t bytes);
+    bool addRegion();
+    MallocMetaData* findFreeSpan(size_t bytes) const;
+    void insertFreeSpan(MallocMetaData* span, size_t bytes);
+    void removeFreeSpan(MallocMetaData* span);
+};
+size_t spanBytes(size_t size);
+/**
+ * This is a heap backend that works like a private program break: a big PROT_NONE region is reserved up front
+ * and made accessible (committed) on demand, so the heap stays contiguous whoever else calls sbrk/brk.
+ */
+class ReservedRegion {
+public:
+    char* base = nullptr;
+    size_t reserved = 0;
+    size_t used = 0;
+    size_t committed = 0;
+    void* grow(size_t bytes);
+    bool reserve(size_t bytes);
+};
+/**
+ * Placement policies decide the order of the blocks inside a bin and which free block serves a request.
+ * insertBefore(existing, block) - should block be inserted before existing in its bin
+ * search(head, min_bin, bin_num, size) - pick a free block with size >= size (nullptr if none)
+ * size_ordered - bins are sorted by size, so a bin's tail is its biggest block
+ */
+inline MallocMetaData* firstFitInBins(MallocMetaData* const* head, int min_bin, int bin_num, size_t size) {
+    for (int i = min_bin; i < bin_num ; ++i) {
+        MallocMetaData* ptr = head[i];
+        while(ptr) {
+            if(ptr->size >= size) {
+                return ptr;
+            }
+            ptr = ptr->next_in_bin;
+        }
+    }
+    /* Didnt find any */
+    return nullptr;
+}
+
+/**
+ * Bins sorted by size (address among equal sizes) - the first block that fits is the best fit
+ */
+struct BestFit {
+    static const bool size_ordered = true;
+    static bool insertBefore(MallocMetaData* existing, MallocMetaData* block) {
+        return existing->size > block->size or (existing->size == block->size and existing > block);
+    }
+    MallocMetaData* search(MallocMetaData* const* head, int min_bin, int bin_num, size_t size) {
+        return firstFitInBins(head, min_bin, bin_num, size);
+    }
+};
+
+/**
+ * Bins sorted by address - the lowest block that fits (keeps the heap compact towards its start)
+ */
+struct FirstFitAddressOrdered {
+    static const bool size_ordered = false;
+    static bool insertBefore(MallocMetaData* existing, MallocMetaData* block) {
+        return existing > block;
+    }
+    MallocMetaData* search(MallocMetaData* const* head, int min_bin, int bin_num, size_t size) {
+        return firstFitInBins(head, min_bin, bin_num, size);
+    }
+};
+
+/**
+ * Bins sorted by address - the search continues after the last block it handed out and wraps around
+ */
+struct NextFit {
+    static const bool size_ordered = false;
+    /* Address of the last block handed out (an address, so merges can't leave it dangling) */
+    MallocMetaData* rover = nullptr;
+    static bool insertBefore(MallocMetaData* existing, MallocMetaData* block) {
+        return existing > block;
+    }
+    MallocMetaData* search(MallocMetaData* const* head, int min_bin, int bin_num, size_t size) {
+        for (int i = min_bin; i < bin_num ; ++i) {
+            MallocMetaData* wrapped = nullptr;
+            for (MallocMetaData* ptr = head[i]; ptr; ptr = ptr->next_in_bin) {
+                if(ptr->size < size) {
+                    continue;
+                }
+                if(ptr > rover) {
+                    rover = ptr;
+                    return ptr;
+                }
+                if(wrapped == nullptr) {
+                    wrapped = ptr;
+                }
+            }
+            if(wrapped) {
+                rover = wrapped;
+                return wrapped;
+            }
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * Freed blocks go to the head of their bin - the most recently freed (cache warm) block that fits is reused first
+ */
+struct Lifo {
+    static const bool size_ordered = false;
+    static bool insertBefore(MallocMetaData*, MallocMetaData*) {
+        return true;
+    }
+    MallocMetaData* search(MallocMetaData* const* head, int min_bin, int bin_num, size_t size) {
+        return firstFitInBins(head, min_bin, bin_num, size);
+    }
+};
+
+/**
+ * Split policy - split a block only if the remainder would get at least MinRemainder bytes
+ */
+template<size_t MinRemainder>
+struct MinRemainderSplit {
+    static bool shouldSplit(MallocMetaData* block, size_t new_size) {
+        return block->size >= new_size + sizeof(MallocMetaData) + MinRemainder;
+    }
+};
+
+/**
+ * This is a class that handles the meta data list of blocks
+ * @tparam Placement placement policy (BestFit, FirstFitAddressOrdered, NextFit, Lifo)
+ * @tparam Split split policy (MinRemainderSplit)
+ * @tparam BinNum number of bins (1KB each, the last one takes everything bigger)
+ * @tparam MmapBin index of the mmapped bin, the default mmap threshold is MmapBin KB
+ */
+template<class Placement = BestFit, class Split = MinRemainderSplit<1>, int BinNum = BIN_NUM, int MmapBin = MMAP_BIN>
+class BlockMetaDataList {
+public:
+    /* BinNum bins + 1 extra bin for mmapped  */
+    MallocMetaData* head[BinNum + 1] = {};
+    MallocMetaData* tail[BinNum + 1] = {};
+    MallocMetaData* combined_list_head = nullptr;
+    MallocMetaData* combined_list_tail = nullptr;
+    size_t num_free_bytes = 0;
+    size_t num_free_blocks = 0;
+    size_t total_bytes = 0;
+    size_t total_blocks = 0;
+    Placement placement;
+    /* Requests bigger than mmap_threshold are mmapped, it rises up to mmap_threshold_max when mmapped blocks are freed */
+    size_t mmap_threshold = (size_t)(MmapBin * 1e3);
+    size_t mmap_threshold_max = DEFAULT_MMAP_THRESHOLD_MAX;
+    bool mmap_threshold_dynamic = true;
+    /* Requests above mmap_threshold and up to page_heap_max come from the page heap (0 disables it) */
+    size_t page_heap_max = DEFAULT_PAGE_HEAP_MAX;
+    PageHeap page_heap;
+    /* Chunked heap growth, the part of a chunk that wasn't asked for (the slack) is left as a free wilderness */
+    size_t sbrk_chunk = DEFAULT_SBRK_CHUNK;
+    size_t next_sbrk_chunk = DEFAULT_SBRK_CHUNK;
+    size_t sbrk_slack = 0;
+    size_t num_sbrk_calls = 0;
+    /* Requests the slack served that growing exactly would have needed an sbrk for */
+    size_t num_sbrk_calls_saved = 0;
+    /* Where the heap grows from */
+    int heap_backend = DEFAULT_HEAP_BACKEND;
+    ReservedRegion reserved_region;
+    /* Deferred coalescing: freed blocks wait (unmerged, chained through next_in_bin) in the unsorted list
+     * until an allocation misses or the list grows past deferred_limit (0 - coalesce on every free) */
+    size_t deferred_limit = 0;
+    MallocMetaData* unsorted_head = nullptr;
+    size_t unsorted_count = 0;
+    /* Running aggregates behind heapStats() */
+    size_t bin_free_blocks[BinNum] = {};
+    size_t bin_free_bytes[BinNum] = {};
+    size_t mmapped_blocks = 0;
+    size_t mmapped_bytes = 0;
+    size_t page_heap_blocks = 0;
+    size_t page_heap_bytes = 0;
+    /* Page heap and mmapped blocks in use, linked through next / prev (heap iteration) */
+    MallocMetaData* mmapped_list_head = nullptr;
+    bool isEmpty(int i) const;
+    bool isSingleBlock(int i) const;
+    int getBinIndex(size_t size);
+    bool isMmapSize(size_t size) const;
+    bool isPageHeapSize(size_t size) const;
+    MallocMetaData *allocateBlock(size_t size, int flag);
+    MallocMetaData* allocateAlignedBlock(size_t size, size_t alignment);
+    MallocMetaData* mmapAlignedBlock(size_t size, size_t alignment);
+    MallocMetaData* searchFreeBlock(size_t size);
+    void insertBlockToBinList(MallocMetaData* block);
+    void removeFromBinList(MallocMetaData *block);
+    void removeFromCombinedList(MallocMetaData *block);
+    void insertToCombinedList(MallocMetaData* block);
+    void insertAfterToCombinedList(MallocMetaData* left, MallocMetaData* new_block);
+    void insertToMmappedList(MallocMetaData* block);
+    void removeFromMmappedList(MallocMetaData* block);
+    void freeBlock(MallocMetaData *p, int merge_flag = MERGE);
+    void occupyBlock(MallocMetaData* p);
+    void mergeFreeBlocks(MallocMetaData* middle);
+    MallocMetaData *splitBlock(MallocMetaData *block, size_t first_block_size);
+    bool checkSplit(MallocMetaData *block, size_t new_size) const;
+    MallocMetaData * expandAndOccupyWilderness(size_t size);
+    size_t growthSize(size_t needed);
+    void* growHeap(size_t bytes);
+    bool reserveHeap(size_t bytes, int flags);
+    MallocMetaData* takeUnsorted(size_t size);
+    void consolidate();
+    size_t largestFreeBlock() const;
+    void heapStats(SHeapStats* stats) const;
+    bool writeSnapshot(int fd);
+    int iterate(SHeapVisitor visitor, void* ctx) const;
+
+    void mergeRight(MallocMetaData *middle, MallocMetaData *right);
+
+    void mergeLeft(MallocMetaData *left, MallocMetaData *middle);
+};
+
+/**
+ * Search for a free block in list that is compatible or allocates and inserts a new block to the end of the list
+ * @param size
+ * @return nullptr if there is not a compatible block and sbrk() fails to add another block. (or size is 0 / bigger than 1e8)
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+MallocMetaData * BlockMetaDataList<Placement, Split, BinNum, MmapBin>::allocateBlock(size_t size, int flag) {
+    if(size <= 0 or size > 1e8) {
+        return nullptr;
+    }
+    if(isPageHeapSize(size)) {
+        MallocMetaData* block = page_heap.allocateSpan(spanBytes(size));
+        if(block == nullptr) {
+            return nullptr;
+        }
+        SCOUNT(SCOUNT_ALLOC_PAGE_HEAP);
+        block->size = size;
+        block->is_free = false;
+        block->is_mmapped = true;
+        block->in_page_heap = true;
+        block->is_deferred = false;
+        total_blocks++;
+        total_bytes += size;
+        page_heap_blocks++;
+        page_heap_bytes += size;
+        insertToMmappedList(block);
+        return block;
+    }
+    if(isMmapSize(size)) {
+        SCOUNT(SCOUNT_MMAP_CALL);
+        void* addr = mmap(NULL,sizeof(MallocMetaData) + size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED ) {
+            return nullptr;
+        }
+        SCOUNT(SCOUNT_ALLOC_MMAP);
+        MallocMetaData* block = (MallocMetaData*)(addr);
+        block->size = size;
+        block->is_free = false;
+        block->is_mmapped = true;
+        block->in_page_heap = false;
+        block->is_deferred = false;
+        total_blocks++;
+        total_bytes += size;
+        mmapped_blocks++;
+        mmapped_bytes += size;
+        insertToMmappedList(block);
+        return block;
+    }
+    /* **************** Small block **************** */
+
+    /* Deferred frees of the same size go right back out, anything else is a miss - coalesce them now */
+    if(unsorted_head) {
+        MallocMetaData* block = takeUnsorted(size);
+        if(block != nullptr) {
+            SCOUNT(SCOUNT_ALLOC_UNSORTED_HIT);
+            return block;
+        }
+        consolidate();
+    }
+    /* A. Check to see if there is a compatible free block */
+    MallocMetaData* block = searchFreeBlock(size);
+    if(block != nullptr) {
+        SCOUNT(SCOUNT_ALLOC_SEARCH_HIT);
+        if(block == WILDERNESS and sbrk_slack > 0) {
+            /* Growing exactly would have left only the wilderness below the slack - an sbrk was saved if it is too small */
+            sbrk_slack = std::min(sbrk_slack, block->size);
+            if(block->size - sbrk_slack < size) {
+                num_sbrk_calls_saved++;
+            }
+            /* The carve starts at the bottom, the slack is what is left above it */
+            sbrk_slack = std::min(sbrk_slack, block->size - std::min(block->size, size + sizeof(MallocMetaData)));
+        }
+        occupyBlock(block);
+        if(checkSplit(block,size)) {
+            block = splitBlock(block, size);
+        }
+        return block;
+    }
+    SCOUNT(SCOUNT_ALLOC_SEARCH_MISS);
+    /* B. Trying to expand wilderness */
+    if(WILDERNESS and (flag == ENABLE_WILDERNESS_EXTEND or WILDERNESS->is_free)) {
+        block = expandAndOccupyWilderness(size);
+        if(block == nullptr) {
+            return nullptr;
+        }
+        SCOUNT(SCOUNT_ALLOC_WILDERNESS);
+        /* Leftover of a chunked growth stays as a free wilderness */
+        if(checkSplit(block, size)) {
+            block = splitBlock(block, size);
+        }
+        return block;
+    }
+    /* C. Allocating a new block */
+    size_t growth = growthSize(sizeof(MallocMetaData) + size);
+    void* addr = growHeap(growth);
+    if(addr == nullptr) {
+        return nullptr;
+    }
+    SCOUNT(SCOUNT_ALLOC_NEW_BLOCK);
+    block = (MallocMetaData*)(addr);
+    block->size = growth - sizeof(MallocMetaData);
+    block->is_free = false;
+    block->is_mmapped = false;
+    block->in_page_heap = false;
+    block->is_deferred = false;
+    insertToCombinedList(block);
+    total_blocks++;
+    total_bytes += block->size;
+    if(checkSplit(block, size)) {
+        block = splitBlock(block, size);
+    }
+
+    return block;
+}
+
+/**
+ * Allocate a block whose payload address is a multiple of alignment (memalign).
+ * A heap block is over-allocated by alignment and a header, the misaligned front is split off and freed
+ * and the rest is split as usual - the result is a regular heap block.
+ * @param size
+ * @param alignment power of two
+ * @return nullptr on a bad alignment, if size is 0 / bigger than 1e8 or if there is no memory
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+MallocMetaData *BlockMetaDataList<Placement, Split, BinNum, MmapBin>::allocateAlignedBlock(size_t size, size_t alignment) {
+    if(alignment == 0 or (alignment & (alignment - 1)) != 0 or size == 0 or size > 1e8) {
+        return nullptr;
+    }
+    MallocMetaData* block;
+    if(alignment <= MALLOC_ALIGNMENT) {
+        /* Usually aligned already */
+        block = allocateBlock(size, DISABLE_WILDERNESS_EXTEND);
+        if(block == nullptr or ((uintptr_t)(block) + sizeof(MallocMetaData)) % alignment == 0) {
+            return block;
+        }
+        freeBlock(block);
+    }
+    size_t padded_size = size + alignment + sizeof(MallocMetaData);
+    if(isMmapSize(padded_size)) {
+        return mmapAlignedBlock(size, alignment);
+    }
+    block = allocateBlock(padded_size, DISABLE_WILDERNESS_EXTEND);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    uintptr_t payload = (uintptr_t)(block) + sizeof(MallocMetaData);
+    if(payload % alignment != 0) {
+        /* The front needs room for a header and at least one byte */
+        uintptr_t aligned = (payload + sizeof(MallocMetaData) + alignment) & ~(alignment - 1);
+        MallocMetaData* front = block;
+        splitBlock(front, aligned - sizeof(MallocMetaData) - payload);
+        block = front->next;
+        occupyBlock(block);
+        freeBlock(front);
+    }
+    if(checkSplit(block, size)) {
+        block = splitBlock(block, size);
+    }
+    return block;
+}
+
+/**
+ * mmap a block whose payload address is a multiple of alignment, the pages around it are unmapped right away
+ * (so the header may not start its mapping - freeBlock unmaps from the header's page)
+ * @param size
+ * @param alignment power of two
+ * @return nullptr if mmap fails
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+MallocMetaData *BlockMetaDataList<Placement, Split, BinNum, MmapBin>::mmapAlignedBlock(size_t size, size_t alignment) {
+    size_t length = sizeof(MallocMetaData) + size + alignment;
+    SCOUNT(SCOUNT_MMAP_CALL);
+    void* addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED) {
+        return nullptr;
+    }
+    SCOUNT(SCOUNT_ALLOC_MMAP);
+    uintptr_t page_mask = (uintptr_t)(getpagesize()) - 1;
+    uintptr_t start = (uintptr_t)(addr);
+    uintptr_t payload = (start + sizeof(MallocMetaData) + alignment - 1) & ~(alignment - 1);
+    uintptr_t first_page = (payload - sizeof(MallocMetaData)) & ~page_mask;
+    uintptr_t end = (payload + size + page_mask) & ~page_mask;
+    uintptr_t map_end = (start + length + page_mask) & ~page_mask;
+    if(first_page > start) {
+        SCOUNT(SCOUNT_MUNMAP_CALL);
+        munmap(addr, first_page - start);
+    }
+    if(map_end > end) {
+        SCOUNT(SCOUNT_MUNMAP_CALL);
+        munmap((void*)(end), map_end - end);
+    }
+    MallocMetaData* block = (MallocMetaData*)(payload - sizeof(MallocMetaData));
+    block->size = size;
+    block->is_free = false;
+    block->is_mmapped = true;
+    block->in_page_heap = false;
+    block->is_deferred = false;
+    total_blocks++;
+    total_bytes += size;
+    mmapped_blocks++;
+    mmapped_bytes += size;
+    insertToMmappedList(block);
+    return block;
+}
+
+/**
+ * Search for a free block with size >= from requested size
+ * @param size
+ * @return nullptr if not found
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+MallocMetaData *BlockMetaDataList<Placement, Split, BinNum, MmapBin>::searchFreeBlock(size_t size) {
+    // should never get here
+    assert(not isMmapSize(size));
+    return placement.search(head, getBinIndex(size), BinNum, size);
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::freeBlock(MallocMetaData *p, int merge_flag) {
+    if(p->is_free) {
+        return;
+    }
+    if(p->in_page_heap) {
+        /* Page heap blocks never cost a syscall, so they don't move the mmap threshold */
+        SCOUNT(SCOUNT_FREE_PAGE_HEAP);
+        total_blocks--;
+        total_bytes -= p->size;
+        page_heap_blocks--;
+        page_heap_bytes -= p->size;
+        removeFromMmappedList(p);
+        page_heap.freeSpan(p, spanBytes(p->size));
+        return;
+    }
+    if(p->is_mmapped) {
+        /* Freeing an mmapped block means blocks of this size come and go - serve them from the heap from now on */
+        if(mmap_threshold_dynamic and p->size > mmap_threshold and p->size <= mmap_threshold_max) {
+            mmap_threshold = p->size;
+        }
+        total_blocks--;
+        total_bytes -= p->size;
+        mmapped_blocks--;
+        mmapped_bytes -= p->size;
+        removeFromMmappedList(p);
+        SCOUNT(SCOUNT_FREE_MMAP);
+        SCOUNT(SCOUNT_MUNMAP_CALL);
+        /* An aligned block's header may sit further into its first page */
+        uintptr_t first_page = (uintptr_t)(p) & ~((uintptr_t)(getpagesize()) - 1);
+        munmap((void*)(first_page), (uintptr_t)(p) - first_page + sizeof(MallocMetaData) + p->size);
+        return;
+    }
+    p->is_free = true;
+    num_free_blocks++;
+    num_free_bytes += p->size;
+    if(merge_flag == MERGE and deferred_limit > 0) {
+        SCOUNT(SCOUNT_FREE_DEFERRED);
+        p->is_deferred = true;
+        p->next_in_bin = unsorted_head;
+        unsorted_head = p;
+        if(++unsorted_count > deferred_limit) {
+            consolidate();
+        }
+        return;
+    }
+    SCOUNT(SCOUNT_FREE_BIN);
+    insertBlockToBinList(p);
+    if(merge_flag == MERGE) {
+        mergeFreeBlocks(p);
+    }
+}
+
+/**
+ * Take a deferred free block of exactly this size out of the unsorted list and occupy it
+ * @param size
+ * @return nullptr if there is none
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+MallocMetaData *BlockMetaDataList<Placement, Split, BinNum, MmapBin>::takeUnsorted(size_t size) {
+    MallocMetaData* prev = nullptr;
+    for (MallocMetaData* block = unsorted_head; block; prev = block, block = block->next_in_bin) {
+        if(block->size != size) {
+            continue;
+        }
+        if(prev) {
+            prev->next_in_bin = block->next_in_bin;
+        }
+        else {
+            unsorted_head = block->next_in_bin;
+        }
+        unsorted_count--;
+        block->is_deferred = false;
+        block->is_free = false;
+        num_free_blocks--;
+        num_free_bytes -= size;
+        return block;
+    }
+    return nullptr;
+}
+
+/**
+ * Drain the unsorted list - bin every deferred block and merge it with its free neighbours
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::consolidate() {
+    if(unsorted_head) {
+        SCOUNT(SCOUNT_CONSOLIDATE);
+    }
+    while(unsorted_head) {
+        MallocMetaData* block = unsorted_head;
+        unsorted_head = block->next_in_bin;
+        block->is_deferred = false;
+        insertBlockToBinList(block);
+        mergeFreeBlocks(block);
+    }
+    unsorted_count = 0;
+}
+
+/**
+ * Biggest free block in the bins (deferred frees aren't binned yet) - it sits in the top non-empty bin,
+ * at its tail when the placement policy keeps bins sorted by size
+ * @return 0 if the bins are empty
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+size_t BlockMetaDataList<Placement, Split, BinNum, MmapBin>::largestFreeBlock() const {
+    for (int i = BinNum - 1; i >= 0; --i) {
+        if(head[i] == nullptr) {
+            continue;
+        }
+        if(Placement::size_ordered) {
+            return tail[i]->size;
+        }
+        size_t largest = 0;
+        for (MallocMetaData* ptr = head[i]; ptr; ptr = ptr->next_in_bin) {
+            largest = std::max(largest, ptr->size);
+        }
+        return largest;
+    }
+    return 0;
+}
+
+/**
+ * Fill stats (see SHeapStats.h) from the running aggregates - O(bins), the heap itself isn't walked
+ * @param stats
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::heapStats(SHeapStats* stats) const {
+    memset(stats, 0, sizeof(*stats));
+    stats->num_bins = std::min(BinNum, SHEAP_STATS_BINS);
+    size_t binned_free_bytes = 0;
+    for (int i = 0; i < BinNum; ++i) {
+        int bin = std::min(i, SHEAP_STATS_BINS - 1);
+        stats->bin_free_blocks[bin] += bin_free_blocks[i];
+        stats->bin_free_bytes[bin] += bin_free_bytes[i];
+        binned_free_bytes += bin_free_bytes[i];
+    }
+    stats->heap_bytes = total_bytes - mmapped_bytes - page_heap_bytes;
+    stats->free_blocks = num_free_blocks;
+    stats->free_bytes = num_free_bytes;
+    stats->largest_free_block = largestFreeBlock();
+    if(binned_free_bytes > 0) {
+        stats->external_fragmentation = 1 - (double)(stats->largest_free_block) / binned_free_bytes;
+    }
+    if(WILDERNESS and WILDERNESS->is_free) {
+        stats->wilderness_bytes = WILDERNESS->size;
+    }
+    stats->deferred_blocks = unsorted_count;
+    stats->deferred_bytes = num_free_bytes - binned_free_bytes;
+    stats->mmapped_blocks = mmapped_blocks;
+    stats->mmapped_bytes = mmapped_bytes;
+    stats->page_heap_blocks = page_heap_blocks;
+    stats->page_heap_bytes = page_heap_bytes;
+    stats->meta_data_bytes = total_blocks * sizeof(MallocMetaData);
+    if(total_blocks > 0) {
+        stats->meta_data_overhead = 100.0 * stats->meta_data_bytes / (stats->meta_data_bytes + total_bytes);
+    }
+}
+
+/**
+ * write() all the bytes, however many calls it takes
+ * @return false on a write error
+ */
+inline bool writeFully(int fd, const void* data, size_t bytes) {
+    const char* next = (const char*)(data);
+    while(bytes > 0) {
+        ssize_t written = write(fd, next, bytes);
+        if(written <= 0) {
+            return false;
+        }
+        next += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+/**
+ * Write a snapshot of the heap (see SHeapSnapshot.h) in one pass over the combined list,
+ * SHEAP_SNAPSHOT_BUFFER_RECORDS blocks per write()
+ * @param fd
+ * @return false on a write error
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+bool BlockMetaDataList<Placement, Split, BinNum, MmapBin>::writeSnapshot(int fd) {
+    SHeapSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHEAP_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SHEAP_SNAPSHOT_VERSION;
+    header.record_size = sizeof(SHeapSnapshotRecord);
+    header.meta_data_size = sizeof(MallocMetaData);
+    header.mmapped_blocks = mmapped_blocks;
+    header.mmapped_bytes = mmapped_bytes;
+    header.page_heap_blocks = page_heap_blocks;
+    header.page_heap_bytes = page_heap_bytes;
+    if(not writeFully(fd, &header, sizeof(header))) {
+        return false;
+    }
+    SHeapSnapshotRecord buffer[SHEAP_SNAPSHOT_BUFFER_RECORDS];
+    size_t count = 0;
+    for (MallocMetaData* block = combined_list_head; block; block = block->next) {
+        SHeapSnapshotRecord& record = buffer[count++];
+        record.address = (uint64_t)(uintptr_t)(block);
+        record.size = block->size;
+        record.state = block->is_deferred ? SHEAP_BLOCK_DEFERRED : block->is_free ? SHEAP_BLOCK_FREE : SHEAP_BLOCK_USED;
+        record.bin = getBinIndex(block->size);
+        if(count == SHEAP_SNAPSHOT_BUFFER_RECORDS) {
+            if(not writeFully(fd, buffer, count * sizeof(SHeapSnapshotRecord))) {
+                return false;
+            }
+            count = 0;
+        }
+    }
+    return writeFully(fd, buffer, count * sizeof(SHeapSnapshotRecord));
+}
+
+/**
+ * Call visitor with every block - the heap in address order, then the page heap and mmapped blocks
+ * (the engines are single threaded, so the walk sees the heap as it is between two calls)
+ * @param visitor returns non-zero to stop the walk, must not allocate or free blocks of this list
+ * @param ctx passed to visitor
+ * @return 0 if visitor stopped the walk, 1 otherwise
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+int BlockMetaDataList<Placement, Split, BinNum, MmapBin>::iterate(SHeapVisitor visitor, void* ctx) const {
+    SHeapBlock info;
+    for (MallocMetaData* block = combined_list_head; block; block = block->next) {
+        info.payload = (char*)(block) + sizeof(MallocMetaData);
+        info.size = block->size;
+        info.state = block->is_deferred ? SHEAP_BLOCK_DEFERRED : block->is_free ? SHEAP_BLOCK_FREE : SHEAP_BLOCK_USED;
+        info.region = SHEAP_REGION_HEAP;
+        if(visitor(&info, ctx)) {
+            return 0;
+        }
+    }
+    for (MallocMetaData* block = mmapped_list_head; block; block = block->next) {
+        info.payload = (char*)(block) + sizeof(MallocMetaData);
+        info.size = block->size;
+        info.state = SHEAP_BLOCK_USED;
+        info.region = block->in_page_heap ? SHEAP_REGION_PAGE_HEAP : SHEAP_REGION_MMAP;
+        if(visitor(&info, ctx)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+bool BlockMetaDataList<Placement, Split, BinNum, MmapBin>::isEmpty(int i) const {
+    if(i == COMBINED_LIST) {
+        return combined_list_head == nullptr;
+    }
+    return head[i] == nullptr;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+bool BlockMetaDataList<Placement, Split, BinNum, MmapBin>::isSingleBlock(int i) const {
+    if(i == COMBINED_LIST) {
+        return combined_list_head == combined_list_tail;
+    }
+    return head[i] == tail[i];
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::insertBlockToBinList(MallocMetaData *block) {
+
+    assert(not block->is_mmapped);
+    int i = getBinIndex(block->size);
+    bin_free_blocks[i]++;
+    bin_free_bytes[i] += block->size;
+// empty list
+    if(isEmpty(i)) {
+        head[i] = tail[i] = block;
+        block->prev_in_bin = nullptr;
+        block->next_in_bin = nullptr;
+    }
+        // one block in list
+    else if(isSingleBlock(i)) {
+        /*  Insert at the tail */
+        if(not Placement::insertBefore(head[i], block)) {
+            block->prev_in_bin = tail[i];
+            head[i]->next_in_bin = block;
+            block->next_in_bin = nullptr;
+            tail[i] = block;
+        }
+        else {
+            /* Insert at the head  */
+            block->prev_in_bin = nullptr;
+            head[i]->prev_in_bin = block;
+            block->next_in_bin = head[i];
+            head[i] = block;
+        }
+    }
+        // more than one block in list
+    else {
+        /* Find the first block the placement policy puts after me (or nullptr if none exist) */
+        MallocMetaData* insert_before_me = head[i];
+        while(insert_before_me and not Placement::insertBefore(insert_before_me, block)) {
+            insert_before_me = insert_before_me->next_in_bin;
+        }
+        /*Inserting in the middle of the list */
+        if(insert_before_me) {
+
+            if(insert_before_me == head[i]) {
+                /* Insert at the head  */
+                block->prev_in_bin = nullptr;
+                head[i]->prev_in_bin = block;
+                block->next_in_bin = head[i];
+                head[i] = block;
+                return;
+            }
+            /* READ THE FOLLOWING COMMENTS WITH THE VOICE AND TUNE OF JOEY IN "The One in Vegas: Part2 */
+            /* Link: */ https://youtu.be/6OZoP2iWpnU?t=45 */
+
+            // your prev is my prev
+            insert_before_me->prev_in_bin->next_in_bin = block;
+            // and i am his next
+            block->prev_in_bin = insert_before_me->prev_in_bin;
+            // oh wait you're my next
+            block->next_in_bin = insert_before_me;
+            // oh wait im your prev
+            insert_before_me->prev_in_bin = block;
+        }
+            /*Inserting to tail */
+        else {
+            block->prev_in_bin = tail[i];
+            tail[i]->next_in_bin = block;
+            block->next_in_bin = nullptr;
+            tail[i] = block;
+        }
+
+    }
+
+}
+
+/**
+ * Bin of a heap block, blocks bigger than the last bin (heap blocks above 128KB) all share the last bin
+ * @param size
+ * @return index in [0, BinNum)
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+int BlockMetaDataList<Placement, Split, BinNum, MmapBin>::getBinIndex(size_t size) {
+    int index = (int)(size / 1e3);
+    /* https://piazza.com/class/kmeyq2ecrv940z?cid=584  */
+    if(index >= BinNum) {
+        index = BinNum - 1;
+    }
+    return index;
+}
+
+/**
+ * Should a request of this size be mmapped instead of allocated on the heap
+ * @param size
+ * @return true if size is above the current (dynamic) mmap threshold
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+bool BlockMetaDataList<Placement, Split, BinNum, MmapBin>::isMmapSize(size_t size) const {
+    return size > mmap_threshold;
+}
+
+/**
+ * Should a request of this size be served by the page heap
+ * @param size
+ * @return true if size is above the mmap threshold but not above page_heap_max (and its span fits in a region)
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+bool BlockMetaDataList<Placement, Split, BinNum, MmapBin>::isPageHeapSize(size_t size) const {
+    return isMmapSize(size) and size <= page_heap_max and spanBytes(size) <= PAGE_HEAP_MAX_SPAN;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::insertToCombinedList(MallocMetaData *block) {
+
+    /* Inserting new block to end of the list */
+    // empty list
+    if(isEmpty(COMBINED_LIST)) {
+        combined_list_head = combined_list_tail = block;
+        block->prev = nullptr;
+        block->next = nullptr;
+    }
+        // one block in list
+    else if(isSingleBlock(COMBINED_LIST)) {
+        block->prev = combined_list_tail;
+        combined_list_head->next = block;
+        block->next = nullptr;
+        combined_list_tail = block;
+    }
+        // more than one block in list
+    else {
+        combined_list_tail->next = block;
+        block->prev = combined_list_tail;
+        block->next = nullptr;
+        combined_list_tail = block;
+    }
+}
+
+/**
+ * Link a page heap / mmapped block in use at the head of the mmapped list
+ * @param block
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::insertToMmappedList(MallocMetaData *block) {
+    block->prev = nullptr;
+    block->next = mmapped_list_head;
+    if(mmapped_list_head) {
+        mmapped_list_head->prev = block;
+    }
+    mmapped_list_head = block;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::removeFromMmappedList(MallocMetaData *block) {
+    if(block->prev) {
+        block->prev->next = block->next;
+    }
+    else {
+        mmapped_list_head = block->next;
+    }
+    if(block->next) {
+        block->next->prev = block->prev;
+    }
+}
+
+/**
+ * Grow the wilderness (free, or the block being reallocated) so it can hold size bytes and occupy it
+ * @param size
+ * @return the wilderness (may be bigger than size when growing in chunks) or nullptr if sbrk fails
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+MallocMetaData * BlockMetaDataList<Placement, Split, BinNum, MmapBin>::expandAndOccupyWilderness(size_t size) {
+    size_t expansion_size = growthSize(size - WILDERNESS->size);
+    void* addr = growHeap(expansion_size);
+    if(addr == nullptr) { // sbrk fails
+        return nullptr;
+    }
+    total_bytes += expansion_size;
+
+    if(WILDERNESS->is_free) {
+        occupyBlock(WILDERNESS);
+    }
+    WILDERNESS->size += expansion_size;
+    return WILDERNESS;
+}
+
+/**
+ * How much to grow the heap when needed bytes are missing
+ * @param needed
+ * @return needed when growing exactly, otherwise at least the current chunk (which then doubles)
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+size_t BlockMetaDataList<Placement, Split, BinNum, MmapBin>::growthSize(size_t needed) {
+    if(sbrk_chunk == 0) {
+        return needed;
+    }
+    if(next_sbrk_chunk < sbrk_chunk) {
+        next_sbrk_chunk = sbrk_chunk;
+    }
+    size_t growth = std::max(needed, next_sbrk_chunk);
+    growth = (growth + MALLOC_ALIGNMENT - 1) & ~(MALLOC_ALIGNMENT - 1);
+    next_sbrk_chunk = std::min(next_sbrk_chunk * 2, std::max(SBRK_CHUNK_MAX, sbrk_chunk));
+    /* The heap only grows when the wilderness (and any slack left in it) is used up */
+    sbrk_slack = growth - needed;
+    return growth;
+}
+
+/**
+ * Grow the heap through the heap backend (moving the program break or the reserved region's break)
+ * @param bytes
+ * @return start of the new memory (right after the wilderness) or nullptr if the backend fails
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+void *BlockMetaDataList<Placement, Split, BinNum, MmapBin>::growHeap(size_t bytes) {
+    void* addr;
+    if(heap_backend == HEAP_BACKEND_RESERVED) {
+        addr = reserved_region.grow(bytes);
+    }
+    else {
+        if(combined_list_head == nullptr and (uintptr_t)(sbrk(0)) % MALLOC_ALIGNMENT != 0) {
+            /* Start the heap on a MALLOC_ALIGNMENT boundary */
+            if(sbrk(MALLOC_ALIGNMENT - (uintptr_t)(sbrk(0)) % MALLOC_ALIGNMENT) == (void*)(-1)) {
+                return nullptr;
+            }
+        }
+        addr = sbrk(bytes);
+        if(addr == (void*)(-1)) {
+            addr = nullptr;
+        }
+    }
+    if(addr != nullptr) {
+        SCOUNT(SCOUNT_HEAP_GROWTH);
+        num_sbrk_calls++;
+    }
+    return addr;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::mergeFreeBlocks(MallocMetaData *middle) {
+    MallocMetaData* prev = middle->prev;
+    MallocMetaData* next = middle->next;
+    if (isMergeable(next)) {
+        mergeRight(middle, next);
+        if(isMergeable(prev)) {
+            mergeLeft(prev, middle);
+            return;
+        }
+    }
+    if (isMergeable(prev)) {
+        mergeLeft(prev, middle);
+    }
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::removeFromBinList(MallocMetaData *block) {
+    /* if block  is not free its already  not in  bin's list */
+    assert(block->is_free && "UNEXPECTED ERROR:: removeFromBinList: unfree block");
+
+    assert(not block->is_mmapped);
+    int i = getBinIndex(block->size);
+    // block is the only one in list
+    if(isSingleBlock(i)) {
+        /* block is not in bin list */
+        if(head[i] != block) {
+            return;
+        }
+        head[i] = tail[i] = nullptr;
+    }
+        /* Removing the head  */
+    else if(block == head[i]) {
+        head[i] = block->next_in_bin;
+        head[i]->prev_in_bin = nullptr;
+        block->next_in_bin = nullptr;
+    }
+        /* Removing the tail  */
+    else if(block == tail[i]) {
+        tail[i] = block->prev_in_bin;
+        tail[i]->next_in_bin = nullptr;
+        block->prev_in_bin = nullptr;
+    }
+        /* Removing the middle  */
+    else {
+        block->prev_in_bin->next_in_bin = block->next_in_bin;
+        block->next_in_bin->prev_in_bin = block->prev_in_bin;
+        block->prev_in_bin = nullptr;
+        block->next_in_bin = nullptr;
+    }
+    bin_free_blocks[i]--;
+    bin_free_bytes[i] -= block->size;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::removeFromCombinedList(MallocMetaData *block) {
+
+    // block is the only one in list
+    if(isSingleBlock(COMBINED_LIST)) {
+        combined_list_head = combined_list_tail = nullptr;
+        return;
+    }
+        /* Removing the head  */
+    else if(block == combined_list_head) {
+        combined_list_head = block->next;
+        combined_list_head->prev = nullptr;
+        block->next = nullptr;
+    }
+        /* Removing the tail  */
+    else if(block == combined_list_tail) {
+        combined_list_tail = block->prev;
+        combined_list_tail->next = nullptr;
+        block->prev = nullptr;
+    }
+        /* Removing the middle  */
+    else {
+        block->prev->next = block->next;
+        block->next->prev = block->prev;
+        block->prev = nullptr;
+        block->next = nullptr;
+    }
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+MallocMetaData *BlockMetaDataList<Placement, Split, BinNum, MmapBin>::splitBlock(MallocMetaData *block, size_t first_block_size) {
+    assert(block and not block->is_free && "Trying to split a free block");
+    SCOUNT(SCOUNT_SPLIT);
+
+    /* Skipping first block meta data and size and setting the new block meta data */
+    char* p1 = (char*)(block);
+    MallocMetaData* second_block = (MallocMetaData*)(p1 + sizeof(MallocMetaData) + first_block_size);
+
+
+    /* update size */
+    second_block->size = block->size - first_block_size - sizeof(MallocMetaData);
+    block->size = first_block_size;
+    second_block->is_free = false; // for freeing reasons
+    second_block->is_mmapped = false;
+    second_block->in_page_heap = false;
+    second_block->is_deferred = false;
+    second_block->next = second_block->prev = second_block->next_in_bin = second_block->prev_in_bin = nullptr;
+
+    /* Insert the second block after the first block in the combined list (sorted by addresses) */
+    insertAfterToCombinedList(block, second_block);
+    total_blocks++;
+    total_bytes -= sizeof(MallocMetaData);
+    /* Insert new block to the bin list */
+    /* Weird choice not to merge but according to piazza @622
+     * https://piazza.com/class/kmeyq2ecrv940z?cid=622
+     * */
+    freeBlock(second_block, DONT_MERGE);
+
+    return block;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+bool BlockMetaDataList<Placement, Split, BinNum, MmapBin>::checkSplit(MallocMetaData *block, size_t new_size) const {
+    return Split::shouldSplit(block, new_size);
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::insertAfterToCombinedList(MallocMetaData *left, MallocMetaData *new_block) {
+    /* Inserting to tail */
+    if(left == combined_list_tail) {
+        new_block->prev = combined_list_tail;
+        left->next = new_block;
+        new_block->next = nullptr;
+        combined_list_tail = new_block;
+    }
+        /* Inserting in the middle */
+    else {
+        new_block->next = left->next;
+        new_block->next->prev = new_block;
+        left->next = new_block;
+        new_block->prev = left;
+    }
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::mergeLeft(MallocMetaData *left, MallocMetaData *middle) {
+    assert(left and left->is_free and "UNEXPECTED ERROR:: mergeLeft: merging left to unfree");
+    SCOUNT(SCOUNT_MERGE_LEFT);
+    if(middle->is_free) {
+        removeFromBinList(middle);
+        num_free_blocks--;
+        num_free_bytes += sizeof(MallocMetaData); // result of merge
+    }
+    else {
+        num_free_bytes += middle->size + sizeof(MallocMetaData);
+    }
+    total_bytes += sizeof(MallocMetaData);
+    removeFromCombinedList(middle);
+    total_blocks--;
+    /*prev will remain as the new block */
+    removeFromBinList(left);
+    left->size += middle->size + sizeof(MallocMetaData);
+    left->is_free = false;
+    insertBlockToBinList(left); // inserting to the right bin (after size change)
+    left->is_free = true;
+}
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::mergeRight(MallocMetaData *middle, MallocMetaData *right) {
+    assert(right and right->is_free and "UNEXPECTED ERROR:: mergeRight: merging right to unfree");
+    SCOUNT(SCOUNT_MERGE_RIGHT);
+    if(middle->is_free) {
+        removeFromBinList(middle);
+        num_free_blocks--;
+        num_free_bytes += sizeof(MallocMetaData); // result of merge
+    }
+    else {
+        middle->is_free = false;
+        num_free_bytes += middle->size + sizeof(MallocMetaData);
+    }
+    total_bytes += sizeof(MallocMetaData);
+    removeFromBinList(right);
+    removeFromCombinedList(right);
+    total_blocks--;
+    middle->size += right->size + sizeof(MallocMetaData);
+    /*middle will remain as the new block */
+    insertBlockToBinList(middle);
+    middle->is_free = true;
+}
+
+template<class Placement, class Split, int BinNum, int MmapBin>
+void BlockMetaDataList<Placement, Split, BinNum, MmapBin>::occupyBlock(MallocMetaData *p) {
+    assert(p->is_free);
+    // should never get here
+    assert(not p->is_mmapped);
+    num_free_blocks--;
+    num_free_bytes -= p->size;
+    removeFromBinList(p);
+    p->is_free = false;
+}
+
+/**
+ * Number of bytes of the page run that holds a block of this size (including its meta data)
+ */
+inline size_t spanBytes(size_t size) {
+    return (size + sizeof(MallocMetaData) + SPAN_PAGE_SIZE - 1) / SPAN_PAGE_SIZE * SPAN_PAGE_SIZE;
+}
+
+inline PageHeapRegion* regionOf(MallocMetaData* span) {
+    return (PageHeapRegion*)((uintptr_t)(span) & ~(PAGE_HEAP_REGION_SIZE - 1));
+}
+
+/**
+ * Index of the span's first page in its region
+ */
+inline size_t pageOf(MallocMetaData* span) {
+    return ((uintptr_t)(span) & (PAGE_HEAP_REGION_SIZE - 1)) / SPAN_PAGE_SIZE;
+}
+
+/**
+ * Record a span (free or not) at its first and last page of the page map
+ */
+inline void mapSpan(MallocMetaData* span, size_t bytes) {
+    MallocMetaData** pagemap = regionOf(span)->pagemap;
+    pagemap[pageOf(span)] = span;
+    pagemap[pageOf(span) + bytes / SPAN_PAGE_SIZE - 1] = span;
+}
+
+inline int freeListIndex(size_t bytes) {
+    return (int)(std::min(bytes / SPAN_PAGE_SIZE, (size_t)(PAGE_HEAP_LISTS - 1)));
+}
+
+/**
+ * Best fit: the first non-empty list of spans at least as long (found in the bitmap), or the smallest span that fits
+ * in the list of long spans
+ * @param bytes multiple of SPAN_PAGE_SIZE
+ * @return nullptr if no free span fits
+ */
+inline MallocMetaData *PageHeap::findFreeSpan(size_t bytes) const {
+    int first = freeListIndex(bytes);
+    for (int word = first / 64; word < PAGE_HEAP_LISTS / 64; ++word) {
+        uint64_t bits = nonempty_lists[word];
+        if(word == first / 64) {
+            bits &= ~(uint64_t)(0) << (first % 64);
+        }
+        if(bits == 0) {
+            continue;
+        }
+        int i = word * 64 + __builtin_ctzll(bits);
+        if(i < PAGE_HEAP_LISTS - 1) {
+            return free_lists[i];
+        }
+        MallocMetaData* best = nullptr;
+        for (MallocMetaData* span = free_lists[i]; span; span = span->next) {
+            if(span->size >= bytes and (best == nullptr or span->size < best->size)) {
+                best = span;
+            }
+        }
+        return best;
+    }
+    return nullptr;
+}
+
+inline void PageHeap::insertFreeSpan(MallocMetaData *span, size_t bytes) {
+    span->size = bytes;
+    span->is_free = true;
+    mapSpan(span, bytes);
+    int i = freeListIndex(bytes);
+    span->prev = nullptr;
+    span->next = free_lists[i];
+    if(span->next) {
+        span->next->prev = span;
+    }
+    free_lists[i] = span;
+    nonempty_lists[i / 64] |= (uint64_t)(1) << (i % 64);
+}
+
+inline void PageHeap::removeFreeSpan(MallocMetaData *span) {
+    int i = freeListIndex(span->size);
+    if(span->prev) {
+        span->prev->next = span->next;
+    }
+    else {
+        free_lists[i] = span->next;
+    }
+    if(span->next) {
+        span->next->prev = span->prev;
+    }
+    if(free_lists[i] == nullptr) {
+        nonempty_lists[i / 64] &= ~((uint64_t)(1) << (i % 64));
+    }
+}
+
+/**
+ * Take a free span of at least bytes, the rest of it goes back to the free lists
+ * @param bytes multiple of SPAN_PAGE_SIZE, at most PAGE_HEAP_MAX_SPAN
+ * @return the span (its size is left for the caller to set) or nullptr if a new region can't be reserved
+ */
+inline MallocMetaData *PageHeap::allocateSpan(size_t bytes) {
+    MallocMetaData* span = findFreeSpan(bytes);
+    if(span == nullptr) {
+        if(not addRegion()) {
+            return nullptr;
+        }
+        span = findFreeSpan(bytes);
+    }
+    removeFreeSpan(span);
+    if(span->size > bytes) {
+        insertFreeSpan((MallocMetaData*)((char*)(span) + bytes), span->size - bytes);
+    }
+    span->is_free = false;
+    mapSpan(span, bytes);
+    return span;
+}
+
+/**
+ * Coalesce a span with its free neighbours and return it to the free lists (or unmap its region if that leaves
+ * the region entirely free and it isn't the last one)
+ * @param span
+ * @param bytes multiple of SPAN_PAGE_SIZE
+ */
+inline void PageHeap::freeSpan(MallocMetaData *span, size_t bytes) {
+    PageHeapRegion* region = regionOf(span);
+    size_t first_page = pageOf(span);
+    size_t end_page = first_page + bytes / SPAN_PAGE_SIZE;
+    if(first_page > PAGE_HEAP_HEADER_PAGES and region->pagemap[first_page - 1]->is_free) {
+        MallocMetaData* left = region->pagemap[first_page - 1];
+        removeFreeSpan(left);
+        bytes += left->size;
+        span = left;
+    }
+    if(end_page < PAGE_HEAP_REGION_PAGES and region->pagemap[end_page]->is_free) {
+        MallocMetaData* right = region->pagemap[end_page];
+        removeFreeSpan(right);
+        bytes += right->size;
+    }
+    if(bytes == PAGE_HEAP_MAX_SPAN and num_regions > 1) {
+        SCOUNT(SCOUNT_MUNMAP_CALL);
+        munmap(region, PAGE_HEAP_REGION_SIZE);
+        num_regions--;
+        return;
+    }
+    insertFreeSpan(span, bytes);
+}
+
+/**
+ * Reserve a new region (pages are committed by the kernel on first touch) and add its spans as one free span.
+ * Twice the region size is mapped and trimmed, so the region is aligned to its size.
+ * @return false if mmap fails
+ */
+inline bool PageHeap::addRegion() {
+    SCOUNT(SCOUNT_MMAP_CALL);
+    void* addr = mmap(NULL, 2 * PAGE_HEAP_REGION_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    uintptr_t start = (uintptr_t)(addr);
+    uintptr_t region = (start + PAGE_HEAP_REGION_SIZE - 1) & ~(PAGE_HEAP_REGION_SIZE - 1);
+    if(region > start) {
+        SCOUNT(SCOUNT_MUNMAP_CALL);
+        munmap(addr, region - start);
+    }
+    SCOUNT(SCOUNT_MUNMAP_CALL);
+    munmap((void*)(region + PAGE_HEAP_REGION_SIZE), start + PAGE_HEAP_REGION_SIZE - region);
+    num_regions++;
+    insertFreeSpan((MallocMetaData*)(region + PAGE_HEAP_HEADER_PAGES * SPAN_PAGE_SIZE), PAGE_HEAP_MAX_SPAN);
+    return true;
+}
+
+/**
+ * Reserve address space for the heap without committing any memory
+ * @param bytes
+ * @return false if mmap fails
+ */
+inline bool ReservedRegion::reserve(size_t bytes) {
+    void* addr = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    base = (char*)(addr);
+    reserved = bytes;
+    return true;
+}
+
+/**
+ * Move the region's break, committing RESERVED_HEAP_COMMIT sized steps with mprotect when needed
+ * @param bytes
+ * @return the old break or nullptr if the region is exhausted / can't be committed
+ */
+inline void *ReservedRegion::grow(size_t bytes) {
+    if(base == nullptr and not reserve(RESERVED_HEAP_SIZE)) {
+        return nullptr;
+    }
+    if(bytes > reserved - used) {
+        return nullptr;
+    }
+    if(used + bytes > committed) {
+        size_t new_committed = (used + bytes + RESERVED_HEAP_COMMIT - 1) / RESERVED_HEAP_COMMIT * RESERVED_HEAP_COMMIT;
+        new_committed = std::min(new_committed, reserved);
+        if(mprotect(base + committed, new_committed - committed, PROT_READ | PROT_WRITE) != 0) {
+            return nullptr;
+        }
+        committed = new_committed;
+    }
+    void* addr = base + used;
+    used += bytes;
+    return addr;
+}
+
+/**
+ * Grow the heap ahead of time, the new memory joins the (free) wilderness
+ * @param bytes rounded up to MALLOC_ALIGNMENT, so the break stays aligned
+ * @param flags SRESERVE_POPULATE - prefault the new pages
+ * @return false if the backend fails
+ */
+template<class Placement, class Split, int BinNum, int MmapBin>
+bool BlockMetaDataList<Placement, Split, BinNum, MmapBin>::reserveHeap(size_t bytes, int flags) {
+    if(bytes <= sizeof(MallocMetaData) or bytes > SIZE_MAX - MALLOC_ALIGNMENT) {
+        return false;
+    }
+    bytes = (bytes + MALLOC_ALIGNMENT - 1) & ~(MALLOC_ALIGNMENT - 1);
+    consolidate();
+    char* addr = (char*)(growHeap(bytes));
+    if(addr == nullptr) {
+        return false;
+    }
+    if(flags & SRESERVE_POPULATE) {
+        /* Kernels before 5.14 don't know MADV_POPULATE_WRITE - touch every page instead */
+        char* first_page = (char*)((size_t)(addr) & ~(SPAN_PAGE_SIZE - 1));
+        if(madvise(first_page, addr + bytes - first_page, MADV_POPULATE_WRITE) != 0) {
+            for (size_t i = 0; i < bytes; i += SPAN_PAGE_SIZE) {
+                volatile char* page = addr + i;
+                *page = *page;
+            }
+        }
+    }
+    total_bytes += bytes;
+    if(WILDERNESS and WILDERNESS->is_free) {
+        /* Re-bin the wilderness with its new size */
+        removeFromBinList(WILDERNESS);
+        WILDERNESS->size += bytes;
+        num_free_bytes += bytes;
+        insertBlockToBinList(WILDERNESS);
+        return true;
+    }
+    MallocMetaData* block = (MallocMetaData*)(addr);
+    block->size = bytes - sizeof(MallocMetaData);
+    block->is_free = false;
+    block->is_mmapped = false;
+    block->in_page_heap = false;
+    block->is_deferred = false;
+    insertToCombinedList(block);
+    total_blocks++;
+    total_bytes -= sizeof(MallocMetaData);
+    freeBlock(block, DONT_MERGE);
+    return true;
+}
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_BLOCKMETADATALIST_H
@@ -0,0 +1,168 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_BLOCKMETADATALISTAPI_H
+#define MEMORY_UNIT_IMPLEMENTATION_BLOCKMETADATALISTAPI_H
+
+/*
+ * The s* API beyond malloc / free that malloc_3 and malloc_4 share - included by both engines right after they define
+ * their meta_list (inside SMALLOC_ENGINE_BEGIN). An engine that rounds sizes up defines BLOCK_SIZE_ALIGNMENT first.
+ */
+#ifndef BLOCK_SIZE_ALIGNMENT
+#define BLOCK_SIZE_ALIGNMENT 1
+#endif
+
+/**
+ * Usable bytes of an allocated block (like malloc_usable_size), may be more than was asked for
+ * @param p
+ * @return 0 for nullptr
+ */
+size_t smalloc_usable_size(void* p) {
+    if(p == nullptr) {
+        return 0;
+    }
+    char* p1 = (char*)(p);
+    return ((MallocMetaData*)(p1 - sizeof(MallocMetaData)))->size;
+}
+
+/**
+ * Warm up the heap: grow it by bytes up front so later allocations don't need sbrk
+ * @param bytes (rounded up to MALLOC_ALIGNMENT)
+ * @param flags SRESERVE_POPULATE - also prefault the pages so first touches don't fault
+ * @return 1 on success, 0 if the heap can't grow
+ */
+int sreserve(size_t bytes, int flags) {
+    return meta_list.reserveHeap(bytes, flags) ? 1 : 0;
+}
+
+/**
+ * Warm up a size class: reserve room for count blocks of size and leave them split and free in their bin.
+ * The one exception to "no two adjacent free blocks": the prefilled blocks aren't merged with each other (or with the
+ * wilderness above them), or they'd be one block again. A prefilled block merges with its free neighbours once it has
+ * been allocated and freed.
+ * @param size
+ * @param count
+ * @param flags passed to sreserve()
+ * @return 1 on success, 0 on failure (blocks carved until then stay in the bins)
+ */
+int sprefill(size_t size, size_t count, int flags) {
+    if(size == 0 or size > 1e8 or meta_list.isMmapSize(size)) {
+        return 0;
+    }
+    /* Blocks of the size smalloc(size) would carve */
+    size = (size + BLOCK_SIZE_ALIGNMENT - 1) / BLOCK_SIZE_ALIGNMENT * BLOCK_SIZE_ALIGNMENT;
+    if(not sreserve(count * (size + sizeof(MallocMetaData)), flags)) {
+        return 0;
+    }
+    /* Carve all the blocks first (chained through next_in_bin) so each one is carved from fresh memory */
+    MallocMetaData* carved = nullptr;
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        MallocMetaData* block = meta_list.allocateBlock(size, DISABLE_WILDERNESS_EXTEND);
+        if(block == nullptr) {
+            break;
+        }
+        block->next_in_bin = carved;
+        carved = block;
+    }
+    /* Free without merging so the blocks stay ready-split */
+    while(carved) {
+        MallocMetaData* next = carved->next_in_bin;
+        meta_list.freeBlock(carved, DONT_MERGE);
+        carved = next;
+    }
+    return i == count ? 1 : 0;
+}
+
+size_t _num_sbrk_calls() {
+    return meta_list.num_sbrk_calls;
+}
+
+size_t _num_sbrk_calls_saved() {
+    return meta_list.num_sbrk_calls_saved;
+}
+
+/**
+ * Fragmentation statistics of the heap (see SHeapStats.h), O(bins) - the heap isn't walked
+ * @param stats
+ * @return 1
+ */
+int sheap_stats(SHeapStats* stats) {
+    meta_list.heapStats(stats);
+    return 1;
+}
+
+/**
+ * Write a binary snapshot of the heap blocks (see SHeapSnapshot.h, compared by tools/sheap_diff)
+ * @param fd
+ * @return 1 on success, 0 on a write error
+ */
+int sheap_snapshot(int fd) {
+    return meta_list.writeSnapshot(fd) ? 1 : 0;
+}
+
+/**
+ * Visit every block - heap, page heap and mmapped - as an SHeapBlock (see SHeapIterate.h)
+ * @param visitor returns non-zero to stop the walk, must not call the s* API
+ * @param ctx passed to visitor
+ * @return 1
+ */
+int sheap_iterate(SHeapVisitor visitor, void* ctx) {
+    meta_list.iterate(visitor, ctx);
+    return 1;
+}
+
+/**
+ * Tune the allocator (like mallopt)
+ * M_MMAP_THRESHOLD - fix the mmap threshold to value (disables the dynamic threshold)
+ * M_MMAP_THRESHOLD_MAX - cap for the dynamic threshold
+ * M_PAGE_HEAP_MAX - biggest request served by the page heap (0 - mmap everything above the threshold)
+ * M_SBRK_CHUNK - grow the heap by at least value bytes (rounded up to MALLOC_ALIGNMENT) at a time, doubling every
+ *     growth (0 - grow exactly)
+ * M_HEAP_BACKEND - HEAP_BACKEND_SBRK / HEAP_BACKEND_RESERVED, only before the first heap allocation
+ * M_DEFERRED_COALESCE - defer coalescing of up to value freed blocks (0 - coalesce on every free)
+ * @return 1 on success, 0 on bad param/value
+ */
+int smallopt(int param, size_t value) {
+    switch (param) {
+        case M_MMAP_THRESHOLD:
+            if(value > DEFAULT_MMAP_THRESHOLD_MAX) {
+                return 0;
+            }
+            meta_list.mmap_threshold = value;
+            meta_list.mmap_threshold_dynamic = false;
+            return 1;
+        case M_MMAP_THRESHOLD_MAX:
+            if(value < DEFAULT_MMAP_THRESHOLD) {
+                return 0;
+            }
+            meta_list.mmap_threshold_max = value;
+            return 1;
+        case M_PAGE_HEAP_MAX:
+            meta_list.page_heap_max = value;
+            return 1;
+        case M_SBRK_CHUNK:
+            if(value > SIZE_MAX - MALLOC_ALIGNMENT) {
+                return 0;
+            }
+            /* Growing by a multiple of it keeps the break (and so the next block) aligned */
+            value = (value + MALLOC_ALIGNMENT - 1) & ~(MALLOC_ALIGNMENT - 1);
+            meta_list.sbrk_chunk = meta_list.next_sbrk_chunk = value;
+            return 1;
+        case M_DEFERRED_COALESCE:
+            meta_list.deferred_limit = value;
+            if(value == 0) {
+                meta_list.consolidate();
+            }
+            return 1;
+        case M_HEAP_BACKEND:
+            /* The heap can't move once it has blocks */
+            if(not meta_list.isEmpty(COMBINED_LIST) or
+               (value != HEAP_BACKEND_SBRK and value != HEAP_BACKEND_RESERVED)) {
+                return 0;
+            }
+            meta_list.heap_backend = (int)(value);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_BLOCKMETADATALISTAPI_H
@@ -2,14 +2,79 @@
 #ifndef MEMORY_UNIT_IMPLEMENTATION_MALLOC_2_H
 #define MEMORY_UNIT_IMPLEMENTATION_MALLOC_2_H
 
-#endif //MEMORY_UNIT_IMPLEMENTATION_MALLOC_2_H
+#include <unistd.h>
+
 void* smalloc(size_t size);
 void* scalloc(size_t num, size_t size);
 void sfree(void* p) ;
+void sfree_sized(void* p, size_t size);
 void* srealloc(void* oldp, size_t new_size);
+void* smemalign(size_t alignment, size_t size);
+size_t smalloc_usable_size(void* p);
 size_t _num_free_blocks();
 size_t _num_free_bytes();
 size_t _num_allocated_blocks();
 size_t _num_allocated_bytes();
 size_t _size_meta_data();
-size_t _num_meta_data_bytes();
\ No newline at end of file
+size_t _num_meta_data_bytes();
+/* smallopt() parameters - malloc_3 / malloc_4 only (M_MMAP_THRESHOLD has mallopt()'s value, so <malloc.h> agrees) */
+#define M_MMAP_THRESHOLD -3
+#define M_MMAP_THRESHOLD_MAX 2
+#define M_PAGE_HEAP_MAX 3
+#define M_SBRK_CHUNK 4
+#define M_HEAP_BACKEND 5
+#define M_DEFERRED_COALESCE 6
+/* M_HEAP_BACKEND values: the program break, or a private reserved region (so other sbrk users can't break contiguity) */
+#define HEAP_BACKEND_SBRK 0
+#define HEAP_BACKEND_RESERVED 1
+/* sreserve() / sprefill() flags */
+#define SRESERVE_POPULATE 1
+int smallopt(int param, size_t value);
+int sreserve(size_t bytes, int flags);
+int sprefill(size_t size, size_t count, int flags);
+size_t _num_sbrk_calls();
+size_t _num_sbrk_calls_saved();
+/* Heap shape statistics (SHeapStats.h), O(bins) - malloc_3 / malloc_4 only, 0 from other engines */
+typedef struct SHeapStats SHeapStats;
+int sheap_stats(SHeapStats* stats);
+/* Binary snapshot of the heap blocks (SHeapSnapshot.h) - malloc_3 / malloc_4 only, 0 from other engines */
+int sheap_snapshot(int fd);
+/* Every block as an SHeapBlock (SHeapIterate.h), independent of the block header layout - malloc_3 / malloc_4 only */
+typedef struct SHeapBlock SHeapBlock;
+typedef int (*SHeapVisitor)(const SHeapBlock* block, void* ctx);
+int sheap_iterate(SHeapVisitor visitor, void* ctx);
+
+/* Arenas: bump allocation out of smalloc() chunks, everything is freed at once by sarena_reset() / sarena_restore() */
+typedef struct SArena SArena;
+typedef struct SArenaMarker {
+    void* chunk;
+    char* top;
+} SArenaMarker;
+SArena* sarena_create(size_t chunk_size);
+void* sarena_alloc(SArena* arena, size_t size);
+SArenaMarker sarena_save(SArena* arena);
+void sarena_restore(SArena* arena, SArenaMarker marker);
+void sarena_reset(SArena* arena);
+void sarena_destroy(SArena* arena);
+
+/* Path counters and latency histograms of builds with SMALLOC_STATS (SmallocCounters.h) */
+typedef struct SCounters SCounters;
+int scounters_snapshot(SCounters* out);
+void scounters_print(int fd);
+
+/* Dispatch library (libsmalloc) only: pick the engine before the first allocation, SMALLOC_ENGINE=<name> otherwise */
+int sengine_select(const char* name);
+const char* sengine_name();
+/* Dispatch library only: the engines are single threaded - the front ends (the LD_PRELOAD shim, operator new, SPool,
+ * SAllocator) make their s* calls under this one process wide lock, and so must threads that call s* themselves */
+void sengine_lock();
+void sengine_unlock();
+/* Dispatch library only: record every s* call to a binary trace (STrace.h), SMALLOC_TRACE=<path> at the first allocation */
+int strace_start(const char* path);
+void strace_stop();
+/* Dispatch library only: sampling heap profiler (SProfile.h), SMALLOC_PROFILE=<prefix> at the first allocation */
+int sprofile_start(size_t sample_bytes);
+void sprofile_stop();
+int sprofile_dump(int fd);
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_MALLOC_2_H
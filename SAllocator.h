@@ -0,0 +1,116 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SALLOCATOR_H
+#define MEMORY_UNIT_IMPLEMENTATION_SALLOCATOR_H
+
+#include <new>
+#include <cstddef>
+#include <limits>
+#include "Mymalloc.h"
+#if __cplusplus >= 201703L && __has_include(<memory_resource>)
+#include <memory_resource>
+#define SALLOCATOR_HAS_PMR 1
+#endif
+
+/*
+ * Put single containers on the engines without replacing operator new:
+ *     std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, SAllocator<std::pair<const int, int>>> map;
+ *     std::pmr::vector<int> vector(smallocResource());
+ * Blocks come from smalloc(), over-aligned types' from smemalign() (which malloc_1 / malloc_2 don't have), and are
+ * freed with sfree_sized() - all under the engine lock (sengine_lock()), so containers can live in different threads.
+ */
+
+/* Sizes are rounded up to it so blocks of the same engine stay aligned (see MALLOC_ALIGNMENT) */
+#define SALLOCATOR_ALIGNMENT alignof(std::max_align_t)
+
+/**
+ * Allocate bytes aligned to alignment from the engine
+ * @throw std::bad_alloc if the engine is out of memory
+ */
+inline void* sallocatorAllocate(size_t bytes, size_t alignment) {
+    if(bytes > std::numeric_limits<size_t>::max() - SALLOCATOR_ALIGNMENT) {
+        throw std::bad_alloc();
+    }
+    /* 0 bytes still get a unique pointer */
+    if(bytes == 0) {
+        bytes = 1;
+    }
+    bytes = (bytes + SALLOCATOR_ALIGNMENT - 1) & ~(SALLOCATOR_ALIGNMENT - 1);
+    sengine_lock();
+    void* p = alignment > SALLOCATOR_ALIGNMENT ? smemalign(alignment, bytes) : smalloc(bytes);
+    sengine_unlock();
+    if(p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+inline void sallocatorDeallocate(void* p, size_t bytes) noexcept {
+    sengine_lock();
+    sfree_sized(p, bytes);
+    sengine_unlock();
+}
+
+/**
+ * This is a stateless STL allocator on smalloc - all SAllocators are equal
+ */
+template<class T>
+struct SAllocator {
+    typedef T value_type;
+
+    SAllocator() noexcept = default;
+
+    template<class U>
+    SAllocator(const SAllocator<U>&) noexcept {
+    }
+
+    T* allocate(size_t n) {
+        if(n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return (T*)(sallocatorAllocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        sallocatorDeallocate(p, n * sizeof(T));
+    }
+};
+
+template<class T, class U>
+bool operator==(const SAllocator<T>&, const SAllocator<U>&) noexcept {
+    return true;
+}
+
+template<class T, class U>
+bool operator!=(const SAllocator<T>&, const SAllocator<U>&) noexcept {
+    return false;
+}
+
+#ifdef SALLOCATOR_HAS_PMR
+/**
+ * This is a memory resource on smalloc for the std::pmr containers
+ */
+class SMemoryResource : public std::pmr::memory_resource {
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return sallocatorAllocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t) override {
+        sallocatorDeallocate(p, bytes);
+    }
+
+    /* There is only one heap, so any two SMemoryResources can free each other's blocks */
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return dynamic_cast<const SMemoryResource*>(&other) != nullptr;
+    }
+};
+
+/**
+ * The process wide SMemoryResource
+ */
+inline SMemoryResource* smallocResource() noexcept {
+    static SMemoryResource resource;
+    return &resource;
+}
+#endif
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SALLOCATOR_H
@@ -0,0 +1,37 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SHEAPITERATE_H
+#define MEMORY_UNIT_IMPLEMENTATION_SHEAPITERATE_H
+
+#include <cstddef>
+
+/*
+ * Heap iteration (sheap_iterate(), malloc_3 / malloc_4 only): every block is described by an SHeapBlock, so tools
+ * walking the heap don't depend on the engine's block header layout.
+ */
+
+enum SHeapBlockState {
+    SHEAP_BLOCK_USED,
+    SHEAP_BLOCK_FREE,
+    /* Free, waiting in the unsorted list (M_DEFERRED_COALESCE) */
+    SHEAP_BLOCK_DEFERRED
+};
+
+enum SHeapRegion {
+    /* The sbrk / reserved region heap, visited in address order */
+    SHEAP_REGION_HEAP,
+    SHEAP_REGION_PAGE_HEAP,
+    SHEAP_REGION_MMAP
+};
+
+struct SHeapBlock {
+    /* What smalloc() returned for the block (its header sits right before it) */
+    void* payload;
+    size_t size;
+    SHeapBlockState state;
+    SHeapRegion region;
+};
+
+/* Called with every block, returns non-zero to stop the walk. It must not call the engine being walked - in libsmalloc
+ * the walk holds the engine lock (sengine_lock()), and under the LD_PRELOAD shim that rules out malloc too. */
+typedef int (*SHeapVisitor)(const SHeapBlock* block, void* ctx);
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SHEAPITERATE_H
@@ -0,0 +1,43 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SHEAPSNAPSHOT_H
+#define MEMORY_UNIT_IMPLEMENTATION_SHEAPSNAPSHOT_H
+
+#include <cstdint>
+#include "SHeapIterate.h"
+
+/*
+ * Heap snapshots (sheap_snapshot(), malloc_3 / malloc_4 only): an SHeapSnapshotHeader followed by an
+ * SHeapSnapshotRecord per heap block, in address order, up to the end of the file. tools/sheap_diff compares two.
+ */
+
+#define SHEAP_SNAPSHOT_MAGIC "SHEAPSN\1"
+#define SHEAP_SNAPSHOT_VERSION 1
+/* Blocks buffered before a write() */
+#define SHEAP_SNAPSHOT_BUFFER_RECORDS 512
+
+struct SHeapSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    /* Header bytes before every block */
+    uint64_t meta_data_size;
+    /* Blocks off the heap aren't listed, only counted */
+    uint64_t mmapped_blocks;
+    uint64_t mmapped_bytes;
+    uint64_t page_heap_blocks;
+    uint64_t page_heap_bytes;
+};
+
+/**
+ * This is a heap block - its header is at address, the payload follows it
+ */
+struct SHeapSnapshotRecord {
+    uint64_t address;
+    /* Payload bytes */
+    uint64_t size;
+    /* SHeapBlockState */
+    uint32_t state;
+    /* Bin of the size (the bin a free block sits in) */
+    uint32_t bin;
+};
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SHEAPSNAPSHOT_H
@@ -0,0 +1,41 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SHEAPSTATS_H
+#define MEMORY_UNIT_IMPLEMENTATION_SHEAPSTATS_H
+
+#include <cstddef>
+
+/*
+ * Heap shape statistics (sheap_stats(), malloc_3 / malloc_4 only) - what the _num_* counters can't tell:
+ * whether the free memory is usable. Filled from aggregates the engine keeps as it goes, so a call costs O(bins).
+ */
+
+/* Bins in the free block histogram, an engine with more bins folds the rest into the last one */
+#define SHEAP_STATS_BINS 128
+
+struct SHeapStats {
+    /* Heap blocks (without headers) and the free ones among them, deferred frees included */
+    size_t heap_bytes;
+    size_t free_blocks;
+    size_t free_bytes;
+    /* Biggest block in the bins - what a single allocation can get without growing the heap */
+    size_t largest_free_block;
+    /* 1 - largest_free_block / binned free bytes: 0 when all free memory is one block, towards 1 when it is crumbs */
+    double external_fragmentation;
+    /* The free block at the top of the heap (0 if the top block is in use) */
+    size_t wilderness_bytes;
+    /* Freed blocks waiting in the unsorted list (M_DEFERRED_COALESCE) */
+    size_t deferred_blocks;
+    size_t deferred_bytes;
+    size_t mmapped_blocks;
+    size_t mmapped_bytes;
+    size_t page_heap_blocks;
+    size_t page_heap_bytes;
+    /* Headers of all blocks, and their share (percent) of all the bytes the blocks take */
+    size_t meta_data_bytes;
+    double meta_data_overhead;
+    /* Free blocks per bin (bin i holds blocks of [i, i + 1) KB, the last one everything bigger) */
+    int num_bins;
+    size_t bin_free_blocks[SHEAP_STATS_BINS];
+    size_t bin_free_bytes[SHEAP_STATS_BINS];
+};
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SHEAPSTATS_H
@@ -0,0 +1,406 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SPOOL_H
+#define MEMORY_UNIT_IMPLEMENTATION_SPOOL_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include "Mymalloc.h"
+
+/* Threads that get their own magazine in every pool, the rest use the shared free list directly */
+#define SPOOL_MAX_THREADS 64
+#define SPOOL_CACHE_LINE 64
+/* Free list heads are a 48 bit pointer and a 16 bit ABA tag */
+#define SPOOL_POINTER_BITS 48
+
+/**
+ * Small id of the running thread (given back when it exits)
+ * @return id in [0, SPOOL_MAX_THREADS) or -1 if all of them are taken
+ */
+inline int spoolThreadId() {
+    static std::atomic<uint64_t> taken(0);
+    struct ThreadId {
+        int id = -1;
+        ThreadId() {
+            uint64_t ids = taken.load();
+            while(ids != ~(uint64_t)(0)) {
+                int free_id = __builtin_ctzll(~ids);
+                if(taken.compare_exchange_weak(ids, ids | ((uint64_t)(1) << free_id))) {
+                    id = free_id;
+                    break;
+                }
+            }
+        }
+        ~ThreadId() {
+            if(id >= 0) {
+                taken.fetch_and(~((uint64_t)(1) << id));
+            }
+        }
+    };
+    thread_local ThreadId thread_id;
+    return thread_id.id;
+}
+
+/**
+ * This is a pool of T objects carved out of slabs of SlabObjects slots taken from smalloc(), so objects carry no
+ * MallocMetaData of their own.
+ * Free slots go to the calling thread's magazine (no atomics), full magazines are flushed half at a time to a shared
+ * lock-free free list with an ABA tagged head. When the free list holds more than half of the pool, slabs that are
+ * entirely free are given back to the heap - after a shrink that found none, not before SlabObjects more slots were
+ * freed to the list.
+ * Slabs are added and given back under the pool's mutex, and the s* calls are made under the engine lock
+ * (sengine_lock()) they share with every other front end of libsmalloc.
+ */
+template<class T, size_t SlabObjects = 64, size_t MagazineSize = 32>
+class SPool {
+public:
+    SPool() = default;
+    SPool(const SPool&) = delete;
+    SPool& operator=(const SPool&) = delete;
+    ~SPool();
+
+    /**
+     * Construct a T in a free slot
+     * @throw std::bad_alloc if a slab can't be allocated (or whatever T's constructor throws)
+     */
+    template<class... Args>
+    T* create(Args&&... args);
+
+    /**
+     * Destroy an object created by this pool and free its slot
+     */
+    void destroy(T* object);
+
+    /**
+     * Give the slabs all of whose slots are in the shared free list back to the heap
+     */
+    void shrink();
+
+    size_t numSlabs() const {
+        return num_slabs.load();
+    }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char object[sizeof(T)];
+    };
+    struct Slab {
+        Slab* next;
+        /* What smalloc() returned, the slab itself is aligned for Slot */
+        void* block;
+        /* Its slots in the shared free list - only counted by shrinkLocked() */
+        size_t free_count;
+        Slot slots[SlabObjects];
+    };
+    struct alignas(SPOOL_CACHE_LINE) Magazine {
+        size_t count = 0;
+        Slot* slots[MagazineSize];
+    };
+
+    static_assert(sizeof(void*) == 8, "SPool packs the ABA tag into the pointer's upper bits");
+    static_assert(MagazineSize >= 2, "Magazines are flushed half at a time");
+
+    std::atomic<uint64_t> free_head{0};
+    std::atomic<size_t> num_free{0};
+    /* Threads in pop() - shrink() waits for them before a slab they may read goes away */
+    std::atomic<int> poppers{0};
+    std::atomic<size_t> num_slabs{0};
+    /* Slots ever pushed to the shared free list, and the count before which freeSlot() doesn't shrink again */
+    std::atomic<size_t> num_pushed{0};
+    std::atomic<size_t> shrink_after{0};
+    std::mutex slab_lock;
+    Slab* slabs = nullptr;
+    /* The slabs sorted by address (for finding a slot's slab) - kept by addSlab() so shrinking allocates nothing */
+    Slab** sorted_slabs = nullptr;
+    size_t sorted_capacity = 0;
+    Magazine magazines[SPOOL_MAX_THREADS];
+
+    static uint64_t pack(Slot* slot, uint64_t tag) {
+        return (uint64_t)(uintptr_t)(slot) | (tag << SPOOL_POINTER_BITS);
+    }
+    static Slot* slotOf(uint64_t head) {
+        return (Slot*)(uintptr_t)(head & (((uint64_t)(1) << SPOOL_POINTER_BITS) - 1));
+    }
+    static uint64_t tagOf(uint64_t head) {
+        return head >> SPOOL_POINTER_BITS;
+    }
+
+    static void* engineAlloc(size_t size);
+    static void engineFree(void* p);
+    void push(Slot* first, Slot* last, size_t count);
+    Slot* pop();
+    Slot* allocateSlot();
+    void freeSlot(Slot* slot);
+    Slot* addSlab();
+    bool addSorted(Slab* slab);
+    void shrinkLocked();
+};
+
+template<class T, size_t SlabObjects, size_t MagazineSize>
+void* SPool<T, SlabObjects, MagazineSize>::engineAlloc(size_t size) {
+    sengine_lock();
+    void* p = smalloc(size);
+    sengine_unlock();
+    return p;
+}
+
+template<class T, size_t SlabObjects, size_t MagazineSize>
+void SPool<T, SlabObjects, MagazineSize>::engineFree(void* p) {
+    sengine_lock();
+    sfree(p);
+    sengine_unlock();
+}
+
+/**
+ * Push a chain of count slots (linked through next) onto the shared free list
+ */
+template<class T, size_t SlabObjects, size_t MagazineSize>
+void SPool<T, SlabObjects, MagazineSize>::push(Slot* first, Slot* last, size_t count) {
+    /* Counted first so a concurrent pop() never takes num_free below 0 */
+    num_free.fetch_add(count);
+    num_pushed.fetch_add(count);
+    uint64_t head = free_head.load();
+    do {
+        last->next = slotOf(head);
+    } while(not free_head.compare_exchange_weak(head, pack(first, tagOf(head) + 1)));
+}
+
+/**
+ * @return a slot from the shared free list or nullptr if it is empty
+ */
+template<class T, size_t SlabObjects, size_t MagazineSize>
+typename SPool<T, SlabObjects, MagazineSize>::Slot* SPool<T, SlabObjects, MagazineSize>::pop() {
+    poppers.fetch_add(1);
+    uint64_t head = free_head.load();
+    Slot* slot;
+    while((slot = slotOf(head)) != nullptr) {
+        /* slot->next may be stale if another thread took slot meanwhile - then the tag changed and the CAS fails */
+        if(free_head.compare_exchange_weak(head, pack(slot->next, tagOf(head) + 1))) {
+            num_free.fetch_sub(1);
+            break;
+        }
+    }
+    poppers.fetch_sub(1);
+    return slot;
+}
+
+/**
+ * Insert slab into sorted_slabs, growing it (twice as big) when full. Called with slab_lock held.
+ * @return false if smalloc fails
+ */
+template<class T, size_t SlabObjects, size_t MagazineSize>
+bool SPool<T, SlabObjects, MagazineSize>::addSorted(Slab* slab) {
+    size_t count = num_slabs.load();
+    if(count == sorted_capacity) {
+        size_t capacity = sorted_capacity ? 2 * sorted_capacity : 8;
+        Slab** grown = (Slab**)(engineAlloc(capacity * sizeof(Slab*)));
+        if(grown == nullptr) {
+            return false;
+        }
+        std::copy(sorted_slabs, sorted_slabs + count, grown);
+        engineFree(sorted_slabs);
+        sorted_slabs = grown;
+        sorted_capacity = capacity;
+    }
+    Slab** position = std::upper_bound(sorted_slabs, sorted_slabs + count, slab);
+    std::move_backward(position, sorted_slabs + count, sorted_slabs + count + 1);
+    *position = slab;
+    return true;
+}
+
+/**
+ * smalloc a slab, keep its first slot and put the rest on the shared free list
+ * @return nullptr if smalloc fails
+ */
+template<class T, size_t SlabObjects, size_t MagazineSize>
+typename SPool<T, SlabObjects, MagazineSize>::Slot* SPool<T, SlabObjects, MagazineSize>::addSlab() {
+    std::lock_guard<std::mutex> guard(slab_lock);
+    void* block = engineAlloc(sizeof(Slab) + alignof(Slab));
+    if(block == nullptr) {
+        return nullptr;
+    }
+    Slab* slab = (Slab*)(((uintptr_t)(block) + alignof(Slab) - 1) & ~((uintptr_t)(alignof(Slab)) - 1));
+    if(not addSorted(slab)) {
+        engineFree(block);
+        return nullptr;
+    }
+    slab->block = block;
+    slab->next = slabs;
+    slabs = slab;
+    num_slabs.fetch_add(1);
+    for (size_t i = 1; i + 1 < SlabObjects; ++i) {
+        slab->slots[i].next = &slab->slots[i + 1];
+    }
+    if(SlabObjects > 1) {
+        push(&slab->slots[1], &slab->slots[SlabObjects - 1], SlabObjects - 1);
+    }
+    return &slab->slots[0];
+}
+
+template<class T, size_t SlabObjects, size_t MagazineSize>
+typename SPool<T, SlabObjects, MagazineSize>::Slot* SPool<T, SlabObjects, MagazineSize>::allocateSlot() {
+    int id = spoolThreadId();
+    if(id < 0) {
+        Slot* slot = pop();
+        return slot ? slot : addSlab();
+    }
+    Magazine& magazine = magazines[id];
+    if(magazine.count == 0) {
+        /* Refill half a magazine from the shared list */
+        Slot* slot;
+        while(magazine.count < MagazineSize / 2 and (slot = pop()) != nullptr) {
+            magazine.slots[magazine.count++] = slot;
+        }
+        if(magazine.count == 0) {
+            return addSlab();
+        }
+    }
+    return magazine.slots[--magazine.count];
+}
+
+template<class T, size_t SlabObjects, size_t MagazineSize>
+void SPool<T, SlabObjects, MagazineSize>::freeSlot(Slot* slot) {
+    int id = spoolThreadId();
+    if(id < 0) {
+        push(slot, slot, 1);
+    }
+    else {
+        Magazine& magazine = magazines[id];
+        if(magazine.count == MagazineSize) {
+            /* Flush the older half to the shared list as one chain */
+            size_t flushed = MagazineSize / 2;
+            for (size_t i = 0; i + 1 < flushed; ++i) {
+                magazine.slots[i]->next = magazine.slots[i + 1];
+            }
+            push(magazine.slots[0], magazine.slots[flushed - 1], flushed);
+            std::move(magazine.slots + flushed, magazine.slots + MagazineSize, magazine.slots);
+            magazine.count -= flushed;
+        }
+        magazine.slots[magazine.count++] = slot;
+    }
+    /* The pool shrank - more than half of it (and at least two slabs) is free */
+    size_t free_slots = num_free.load();
+    if(free_slots >= 2 * SlabObjects and free_slots > num_slabs.load() * SlabObjects / 2 and
+       num_pushed.load() >= shrink_after.load() and slab_lock.try_lock()) {
+        shrinkLocked();
+        slab_lock.unlock();
+    }
+}
+
+template<class T, size_t SlabObjects, size_t MagazineSize>
+template<class... Args>
+T* SPool<T, SlabObjects, MagazineSize>::create(Args&&... args) {
+    Slot* slot = allocateSlot();
+    if(slot == nullptr) {
+        throw std::bad_alloc();
+    }
+    try {
+        return new (slot->object) T(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        freeSlot(slot);
+        throw;
+    }
+}
+
+template<class T, size_t SlabObjects, size_t MagazineSize>
+void SPool<T, SlabObjects, MagazineSize>::destroy(T* object) {
+    if(object == nullptr) {
+        return;
+    }
+    object->~T();
+    freeSlot((Slot*)(object));
+}
+
+template<class T, size_t SlabObjects, size_t MagazineSize>
+void SPool<T, SlabObjects, MagazineSize>::shrink() {
+    std::lock_guard<std::mutex> guard(slab_lock);
+    shrinkLocked();
+}
+
+/**
+ * Take the whole shared free list, count its slots per slab, sfree the slabs with no slot in use and push the rest back.
+ * Slots in magazines count as used. Called with slab_lock held.
+ */
+template<class T, size_t SlabObjects, size_t MagazineSize>
+void SPool<T, SlabObjects, MagazineSize>::shrinkLocked() {
+    size_t count = num_slabs.load();
+    if(count == 0) {
+        return;
+    }
+    uint64_t head = free_head.load();
+    while(not free_head.compare_exchange_weak(head, pack(nullptr, tagOf(head) + 1))) {
+    }
+    size_t taken = 0;
+    /* Nobody can still be reading a slot of the old list after this */
+    while(poppers.load() != 0) {
+    }
+    for (size_t i = 0; i < count; ++i) {
+        sorted_slabs[i]->free_count = 0;
+    }
+    /* Slab of a slot - the last slab starting at or before it */
+    auto slabOf = [&](Slot* slot) {
+        return *(std::upper_bound(sorted_slabs, sorted_slabs + count, (Slab*)(slot)) - 1);
+    };
+    for (Slot* slot = slotOf(head); slot; slot = slot->next) {
+        slabOf(slot)->free_count++;
+        taken++;
+    }
+    /* Push back the slots of slabs that stay */
+    Slot* first = nullptr;
+    Slot* last = nullptr;
+    size_t kept = 0;
+    Slot* slot = slotOf(head);
+    while(slot) {
+        Slot* next = slot->next;
+        if(slabOf(slot)->free_count != SlabObjects) {
+            slot->next = first;
+            first = slot;
+            if(last == nullptr) {
+                last = slot;
+            }
+            kept++;
+        }
+        slot = next;
+    }
+    num_free.fetch_sub(taken);
+    if(first) {
+        push(first, last, kept);
+    }
+    /* Unlink and free the empty slabs */
+    size_t remaining = std::remove_if(sorted_slabs, sorted_slabs + count, [](Slab* slab) {
+        return slab->free_count == SlabObjects;
+    }) - sorted_slabs;
+    Slab** link = &slabs;
+    while(*link) {
+        Slab* slab = *link;
+        if(slab->free_count == SlabObjects) {
+            *link = slab->next;
+            engineFree(slab->block);
+        }
+        else {
+            link = &slab->next;
+        }
+    }
+    num_slabs.fetch_sub(count - remaining);
+    /* Found nothing - don't look again until enough slots were freed for a slab to have emptied */
+    shrink_after.store(remaining == count ? num_pushed.load() + SlabObjects : 0);
+}
+
+/**
+ * Give every slab back to the heap - objects still alive are not destroyed
+ */
+template<class T, size_t SlabObjects, size_t MagazineSize>
+SPool<T, SlabObjects, MagazineSize>::~SPool() {
+    while(slabs) {
+        Slab* next = slabs->next;
+        engineFree(slabs->block);
+        slabs = next;
+    }
+    engineFree(sorted_slabs);
+}
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SPOOL_H
@@ -0,0 +1,39 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SPROFILE_H
+#define MEMORY_UNIT_IMPLEMENTATION_SPROFILE_H
+
+#include <atomic>
+#include <cstdint>
+#include <unistd.h>
+
+/*
+ * Sampling heap profiler (libsmalloc only), see sprofile_start(). Allocations are sampled about once every
+ * sample_bytes bytes (geometric sampling - every byte is equally likely to be picked), a sample records its call stack
+ * and is charged to that stack's site until it is freed. sprofile_dump() writes the sites in the heap profile format
+ * of gperftools (heap_v2), which pprof reads (pprof -http=: <binary> <profile> for graphs and flame graphs).
+ */
+
+/* Default mean bytes between samples */
+#define SPROFILE_DEFAULT_SAMPLE_BYTES ((size_t)(512 * 1024))
+/* Frames kept of a sampled call stack */
+#define SPROFILE_MAX_DEPTH 32
+
+/* Set while profiling, the s* calls check it before sampling (always inlined, so a stack starts at the s* call) */
+extern std::atomic<bool> sprofile_on;
+
+void sprofileAlloc(size_t size, void* p);
+void sprofileFree(void* p);
+void sprofileStartFromEnv();
+
+__attribute__((always_inline)) inline void sprofileAllocCall(size_t size, void* p) {
+    if(sprofile_on.load(std::memory_order_relaxed) and p) {
+        sprofileAlloc(size, p);
+    }
+}
+
+__attribute__((always_inline)) inline void sprofileFreeCall(void* p) {
+    if(sprofile_on.load(std::memory_order_relaxed) and p) {
+        sprofileFree(p);
+    }
+}
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SPROFILE_H
@@ -0,0 +1,63 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_STRACE_H
+#define MEMORY_UNIT_IMPLEMENTATION_STRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <unistd.h>
+
+/*
+ * Allocation traces (libsmalloc only): every s* call made while tracing is recorded, see strace_start().
+ * A trace file is an STraceHeader followed by STraceRecords. Each thread buffers its records, so the file is only
+ * ordered per thread - sort it by sequence to get the order the calls were made in.
+ */
+
+#define STRACE_MAGIC "STRACE\0\1"
+#define STRACE_VERSION 1
+
+enum STraceOp {
+    STRACE_MALLOC = 1,
+    STRACE_CALLOC,
+    STRACE_FREE,
+    STRACE_REALLOC,
+    STRACE_MEMALIGN
+};
+
+struct STraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+/**
+ * This is one s* call. Objects are identified by their address - unique among the live objects, which is all a replay
+ * needs to pair every sfree / srealloc with the allocation it undoes.
+ */
+struct STraceRecord {
+    /* Order of the call among all threads' calls */
+    uint64_t sequence;
+    /* Since strace_start() */
+    uint64_t timestamp_ns;
+    /* Bytes asked for - num * size for scalloc */
+    uint64_t size;
+    /* What the call returned (sfree - what it was given), 0 for nullptr */
+    uint64_t id;
+    /* srealloc - the object it was given */
+    uint64_t old_id;
+    uint32_t thread;
+    uint16_t op;
+    /* smemalign - log2 of the alignment */
+    uint16_t alignment_shift;
+};
+
+/* Set while tracing, the s* calls check it before recording */
+extern std::atomic<bool> strace_on;
+
+void straceRecord(STraceOp op, size_t size, void* p, void* old_p, size_t alignment);
+
+inline void straceCall(STraceOp op, size_t size, void* p, void* old_p = nullptr, size_t alignment = 0) {
+    if(strace_on.load(std::memory_order_relaxed)) {
+        straceRecord(op, size, p, old_p, alignment);
+    }
+}
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_STRACE_H
@@ -0,0 +1,174 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SMALLOCCOUNTERS_H
+#define MEMORY_UNIT_IMPLEMENTATION_SMALLOCCOUNTERS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <sys/mman.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Path counters and latency histograms of the heap engines, compiled in with -DSMALLOC_STATS (cmake -DSMALLOC_STATS=ON).
+ * Every thread counts into a block of its own (no atomic read-modify-writes), scounters_snapshot() adds the threads up.
+ * Without SMALLOC_STATS SCOUNT / SCOUNT_TIME expand to nothing.
+ */
+
+enum SCounter {
+    /* allocateBlock */
+    SCOUNT_ALLOC_PAGE_HEAP,
+    SCOUNT_ALLOC_MMAP,
+    SCOUNT_ALLOC_UNSORTED_HIT,
+    SCOUNT_ALLOC_SEARCH_HIT,
+    SCOUNT_ALLOC_SEARCH_MISS,
+    SCOUNT_ALLOC_WILDERNESS,
+    SCOUNT_ALLOC_NEW_BLOCK,
+    /* freeBlock */
+    SCOUNT_FREE_BIN,
+    SCOUNT_FREE_DEFERRED,
+    SCOUNT_FREE_MMAP,
+    SCOUNT_FREE_PAGE_HEAP,
+    /* srealloc cases */
+    SCOUNT_REALLOC_A_SAME_BLOCK,
+    SCOUNT_REALLOC_B_MERGE_LEFT,
+    SCOUNT_REALLOC_C_MERGE_RIGHT,
+    SCOUNT_REALLOC_D_MERGE_BOTH,
+    SCOUNT_REALLOC_EF_OTHER_BLOCK,
+    SCOUNT_REALLOC_MMAPPED,
+    /* Block list */
+    SCOUNT_SPLIT,
+    SCOUNT_MERGE_LEFT,
+    SCOUNT_MERGE_RIGHT,
+    SCOUNT_CONSOLIDATE,
+    /* System calls */
+    SCOUNT_HEAP_GROWTH,
+    SCOUNT_MMAP_CALL,
+    SCOUNT_MUNMAP_CALL,
+    SCOUNT_NUM_COUNTERS
+};
+
+/* Timed s* calls */
+enum SCountedOp {
+    SCOUNT_OP_MALLOC, SCOUNT_OP_CALLOC, SCOUNT_OP_FREE, SCOUNT_OP_REALLOC, SCOUNT_OP_MEMALIGN, SCOUNT_NUM_OPS
+};
+
+/* Latency bucket i counts calls that took [2^(i-1), 2^i) ticks (bucket 0 - no tick) */
+#define SCOUNT_BUCKETS 64
+
+/**
+ * This is a snapshot of the counters of all threads (scounters_snapshot())
+ */
+struct SCounters {
+    unsigned long long counters[SCOUNT_NUM_COUNTERS];
+    /* Ticks are TSC cycles on x86, nanoseconds elsewhere */
+    unsigned long long latency[SCOUNT_NUM_OPS][SCOUNT_BUCKETS];
+};
+
+inline const char* scounterName(int counter) {
+    static const char* const names[SCOUNT_NUM_COUNTERS] = {
+            "alloc_page_heap", "alloc_mmap", "alloc_unsorted_hit", "alloc_search_hit", "alloc_search_miss",
+            "alloc_wilderness", "alloc_new_block", "free_bin", "free_deferred", "free_mmap", "free_page_heap",
+            "realloc_a_same_block", "realloc_b_merge_left", "realloc_c_merge_right", "realloc_d_merge_both",
+            "realloc_ef_other_block", "realloc_mmapped", "split", "merge_left", "merge_right", "consolidate",
+            "heap_growth", "mmap_call", "munmap_call"
+    };
+    return names[counter];
+}
+
+inline const char* scountedOpName(int op) {
+    static const char* const names[SCOUNT_NUM_OPS] = {"smalloc", "scalloc", "sfree", "srealloc", "smemalign"};
+    return names[op];
+}
+
+#ifdef SMALLOC_STATS
+
+/**
+ * This is a thread's counters - only its thread writes them, readers may see a count a call behind
+ */
+struct SCountersThread {
+    SCountersThread* next;
+    std::atomic<uint64_t> counters[SCOUNT_NUM_COUNTERS];
+    std::atomic<uint64_t> latency[SCOUNT_NUM_OPS][SCOUNT_BUCKETS];
+};
+
+/* Every thread's counters (they stay when a thread exits, its counts still add up) */
+inline std::atomic<SCountersThread*>& scountersThreads() {
+    static std::atomic<SCountersThread*> threads(nullptr);
+    return threads;
+}
+
+/**
+ * The calling thread's counters, mmapped (off the heap being counted) on its first count
+ * @return nullptr if they can't be mapped
+ */
+inline SCountersThread* scountersThread() {
+    static thread_local SCountersThread* counters = nullptr;
+    if(counters == nullptr) {
+        void* addr = mmap(NULL, sizeof(SCountersThread), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED) {
+            return nullptr;
+        }
+        /* Zeroed by mmap */
+        SCountersThread* created = (SCountersThread*)(addr);
+        created->next = scountersThreads().load();
+        while(not scountersThreads().compare_exchange_weak(created->next, created)) {
+        }
+        counters = created;
+    }
+    return counters;
+}
+
+inline void scountAdd(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline void scount(SCounter counter) {
+    SCountersThread* counters = scountersThread();
+    if(counters) {
+        scountAdd(counters->counters[counter]);
+    }
+}
+
+inline uint64_t scountTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * This is a scope timer - the time from its construction to the end of its scope goes to op's histogram
+ */
+struct SCountTimer {
+    SCountedOp op;
+    uint64_t start;
+
+    explicit SCountTimer(SCountedOp op) : op(op), start(scountTicks()) {
+    }
+
+    ~SCountTimer() {
+        uint64_t ticks = scountTicks() - start;
+        int bucket = ticks ? std::min(64 - __builtin_clzll(ticks), SCOUNT_BUCKETS - 1) : 0;
+        SCountersThread* counters = scountersThread();
+        if(counters) {
+            scountAdd(counters->latency[op][bucket]);
+        }
+    }
+};
+
+#define SCOUNT(counter) scount(counter)
+#define SCOUNT_TIME(op) SCountTimer scount_timer(op)
+
+#else
+
+#define SCOUNT(counter) ((void)0)
+#define SCOUNT_TIME(op) ((void)0)
+
+#endif
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SMALLOCCOUNTERS_H
@@ -0,0 +1,49 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_SMALLOCENGINE_H
+#define MEMORY_UNIT_IMPLEMENTATION_SMALLOCENGINE_H
+
+#include <unistd.h>
+#include "SHeapStats.h"
+#include "SHeapIterate.h"
+
+/*
+ * Every engine (malloc_1.cpp .. malloc_tlsf.cpp) is wrapped with SMALLOC_ENGINE_BEGIN / SMALLOC_ENGINE_END.
+ * Built on its own it exports the global s* API, built for the dispatch library (-DSMALLOC_ENGINE_NAMESPACE=name)
+ * everything it defines lives in namespace name, so all engines can be linked together.
+ */
+#ifdef SMALLOC_ENGINE_NAMESPACE
+#define SMALLOC_ENGINE_BEGIN namespace SMALLOC_ENGINE_NAMESPACE {
+#define SMALLOC_ENGINE_END }
+#else
+#define SMALLOC_ENGINE_BEGIN
+#define SMALLOC_ENGINE_END
+#endif
+
+/**
+ * This is the dispatch table of an engine, entries an engine doesn't implement are nullptr
+ */
+struct SmallocEngine {
+    const char* name;
+    void* (*smalloc)(size_t size);
+    void* (*scalloc)(size_t num, size_t size);
+    void (*sfree)(void* p);
+    void* (*srealloc)(void* oldp, size_t new_size);
+    size_t (*smalloc_usable_size)(void* p);
+    void* (*smemalign)(size_t alignment, size_t size);
+    size_t (*num_free_blocks)();
+    size_t (*num_free_bytes)();
+    size_t (*num_allocated_blocks)();
+    size_t (*num_allocated_bytes)();
+    size_t (*size_meta_data)();
+    size_t (*num_meta_data_bytes)();
+    /* malloc_3 / malloc_4 only */
+    int (*smallopt)(int param, size_t value);
+    int (*sreserve)(size_t bytes, int flags);
+    int (*sprefill)(size_t size, size_t count, int flags);
+    size_t (*num_sbrk_calls)();
+    size_t (*num_sbrk_calls_saved)();
+    int (*sheap_stats)(SHeapStats* stats);
+    int (*sheap_snapshot)(int fd);
+    int (*sheap_iterate)(SHeapVisitor visitor, void* ctx);
+};
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_SMALLOCENGINE_H
@@ -0,0 +1,368 @@
+//
+// Shared pieces of the engine benchmarks: engines behind one table (libsmalloc engines and glibc),
+// a fresh process per run, latency samples kept off the measured heap and hardware counters around each phase.
+//
+
+#ifndef MEMORY_UNIT_IMPLEMENTATION_BENCHHARNESS_H
+#define MEMORY_UNIT_IMPLEMENTATION_BENCHHARNESS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "Mymalloc.h"
+
+/**
+ * This is the allocation API of an engine under test
+ */
+struct BenchEngine {
+    const char* name;
+    void* (*allocate)(size_t size);
+    void (*release)(void* p);
+    void* (*zeroAllocate)(size_t num, size_t size);
+    void* (*reallocate)(void* p, size_t size);
+};
+
+inline void* glibcMalloc(size_t size) {
+    return malloc(size);
+}
+
+inline void glibcFree(void* p) {
+    free(p);
+}
+
+inline void* glibcCalloc(size_t num, size_t size) {
+    return calloc(num, size);
+}
+
+inline void* glibcRealloc(void* p, size_t size) {
+    return realloc(p, size);
+}
+
+/**
+ * Point engine at glibc or at a libsmalloc engine - call it in the process that runs the benchmark,
+ * a libsmalloc engine can't change after the first allocation
+ * @param name glibc or a name sengine_select() knows
+ * @return false if there is no such engine
+ */
+inline bool benchSelectEngine(const char* name, BenchEngine* engine) {
+    if(strcmp(name, "glibc") == 0) {
+        *engine = {"glibc", glibcMalloc, glibcFree, glibcCalloc, glibcRealloc};
+        return true;
+    }
+    if(not sengine_select(name)) {
+        return false;
+    }
+    *engine = {sengine_name(), smalloc, sfree, scalloc, srealloc};
+    if(strcmp(name, "malloc_1") == 0) {
+        /* malloc_1 can only allocate (sfree does nothing) */
+        engine->zeroAllocate = nullptr;
+        engine->reallocate = nullptr;
+    }
+    return true;
+}
+
+/**
+ * Small xorshift generator - no allocations and the same sequence for every engine
+ */
+struct BenchRandom {
+    uint64_t state;
+
+    explicit BenchRandom(uint64_t seed) : state(seed * 2654435761ULL + 88172645463325252ULL) {
+    }
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    /* Uniform in [0, 1) */
+    double nextDouble() {
+        return (double)(next() >> 11) / (double)((uint64_t)(1) << 53);
+    }
+};
+
+inline void* benchMapArray(size_t bytes) {
+    void* addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return addr == MAP_FAILED ? nullptr : addr;
+}
+
+inline uint64_t benchNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * This is a set of per operation latencies, kept in mmapped memory so it never touches the heap being measured
+ */
+struct LatencySamples {
+    uint32_t* ns = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+    uint64_t total_ns = 0;
+
+    bool init(size_t max_samples) {
+        ns = (uint32_t*)(benchMapArray(max_samples * sizeof(uint32_t)));
+        capacity = max_samples;
+        count = 0;
+        total_ns = 0;
+        return ns != nullptr;
+    }
+
+    void clear() {
+        count = 0;
+        total_ns = 0;
+    }
+
+    void add(uint64_t sample_ns) {
+        total_ns += sample_ns;
+        if(count < capacity) {
+            ns[count++] = (uint32_t)(std::min(sample_ns, (uint64_t)(UINT32_MAX)));
+        }
+    }
+
+    /**
+     * Sort the samples and take a percentile
+     * @param fraction in [0, 1]
+     */
+    uint32_t percentile(double fraction) {
+        if(count == 0) {
+            return 0;
+        }
+        std::sort(ns, ns + count);
+        size_t i = std::min((size_t)(fraction * count), count - 1);
+        return ns[i];
+    }
+
+    double opsPerSec() const {
+        return total_ns ? count * 1e9 / total_ns : 0;
+    }
+};
+
+enum PerfCounter {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_PAGE_FAULTS,
+    PERF_NUM_COUNTERS
+};
+
+inline const char* perfCounterName(int counter) {
+    static const char* const names[PERF_NUM_COUNTERS] = {
+            "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "page_faults"
+    };
+    return names[counter];
+}
+
+/**
+ * This is what the counters counted over one phase - a counter the kernel didn't give us isn't valid
+ */
+struct PerfSample {
+    uint64_t counts[PERF_NUM_COUNTERS] = {};
+    bool valid[PERF_NUM_COUNTERS] = {};
+};
+
+/**
+ * This is a set of perf_event_open counters of the calling process (user space only, so perf_event_paranoid 2 is
+ * enough). Counters that can't be opened (no PMU in a VM, seccomp, paranoid 3) are left out, page faults then come
+ * from getrusage().
+ */
+struct PerfCounters {
+    int fds[PERF_NUM_COUNTERS];
+    long start_faults = 0;
+
+    PerfCounters() {
+        std::fill(fds, fds + PERF_NUM_COUNTERS, -1);
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if(fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    /**
+     * Open every counter the kernel lets us have
+     * @param inherit also count the threads created afterwards (they are added in when they exit)
+     */
+    void open(bool inherit = false) {
+        static const uint32_t types[PERF_NUM_COUNTERS] = {
+                PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE,
+                PERF_TYPE_SOFTWARE
+        };
+        static const uint64_t configs[PERF_NUM_COUNTERS] = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                PERF_COUNT_SW_PAGE_FAULTS
+        };
+        for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.inherit = inherit;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            /* More hardware counters than the PMU has are multiplexed - counts are scaled by the time they ran */
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = (int)(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+    }
+
+    static long rusageFaults() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_minflt + usage.ru_majflt;
+    }
+
+    void start() {
+        start_faults = rusageFaults();
+        for (int fd : fds) {
+            if(fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    PerfSample stop() {
+        PerfSample sample;
+        for (int fd : fds) {
+            if(fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+            /* value, time enabled, time running */
+            uint64_t values[3];
+            if(fds[i] < 0 or read(fds[i], values, sizeof(values)) != sizeof(values) or values[2] == 0) {
+                continue;
+            }
+            sample.counts[i] = values[2] < values[1] ? (uint64_t)((double)(values[0]) * values[1] / values[2])
+                                                     : values[0];
+            sample.valid[i] = true;
+        }
+        if(not sample.valid[PERF_PAGE_FAULTS]) {
+            sample.counts[PERF_PAGE_FAULTS] = rusageFaults() - start_faults;
+            sample.valid[PERF_PAGE_FAULTS] = true;
+        }
+        return sample;
+    }
+};
+
+/**
+ * Format the counters of a sample per operation as JSON "key": value pairs (null for a counter that wasn't available)
+ */
+inline std::string benchFormatPerf(const PerfSample& sample, uint64_t ops) {
+    std::string pairs;
+    char pair[64];
+    for (int i = 0; i < PERF_NUM_COUNTERS; ++i) {
+        if(sample.valid[i]) {
+            snprintf(pair, sizeof(pair), "%s\"%s_per_op\": %.3f", i ? ", " : "", perfCounterName(i),
+                     ops ? (double)(sample.counts[i]) / ops : 0);
+        }
+        else {
+            snprintf(pair, sizeof(pair), "%s\"%s_per_op\": null", i ? ", " : "", perfCounterName(i));
+        }
+        pairs += pair;
+    }
+    return pairs;
+}
+
+/**
+ * Write one JSON counters record (a line) for a phase of a run: fields is the record's leading "key": value pairs
+ */
+inline void benchWritePerf(int fd, const char* fields, const char* phase, uint64_t ops, const PerfSample& sample) {
+    dprintf(fd, "{%s, \"phase\": \"%s\", \"ops\": %llu, %s}\n", fields, phase, (unsigned long long)(ops),
+            benchFormatPerf(sample, ops).c_str());
+}
+
+/**
+ * Write one JSON result record (a line) for an operation: fields is the record's leading "key": value pairs
+ */
+inline void benchWriteRecord(int fd, const char* fields, const char* op, LatencySamples& samples) {
+    double ops_per_sec = samples.opsPerSec();
+    uint32_t p50 = samples.percentile(0.5);
+    uint32_t p99 = samples.percentile(0.99);
+    uint32_t p999 = samples.percentile(0.999);
+    dprintf(fd, "{%s, \"op\": \"%s\", \"count\": %zu, \"ops_per_sec\": %.0f, "
+                "\"p50_ns\": %u, \"p99_ns\": %u, \"p999_ns\": %u}\n",
+            fields, op, samples.count, ops_per_sec, p50, p99, p999);
+}
+
+/**
+ * Run body(fd) in a forked child - every run gets a fresh heap - and collect the lines it writes to fd
+ * @param records the child's output is appended here
+ * @return false if the child couldn't run or didn't exit with 0
+ */
+template<class Body>
+bool benchRunInChild(Body body, std::string& records) {
+    int fds[2];
+    if(pipe(fds) != 0) {
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if(pid == 0) {
+        close(fds[0]);
+        int status = body(fds[1]);
+        close(fds[1]);
+        _exit(status);
+    }
+    close(fds[1]);
+    char buffer[4096];
+    ssize_t bytes;
+    while((bytes = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        records.append(buffer, bytes);
+    }
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) and WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Print newline separated JSON records as {"benchmark": name, "results": [...]}
+ */
+inline void benchPrintJson(const char* name, const std::string& records) {
+    printf("{\"benchmark\": \"%s\", \"results\": [\n", name);
+    size_t start = 0;
+    bool first = true;
+    while(start < records.size()) {
+        size_t end = records.find('\n', start);
+        if(end == std::string::npos) {
+            end = records.size();
+        }
+        if(end > start) {
+            printf("%s  %s", first ? "" : ",\n", records.substr(start, end - start).c_str());
+            first = false;
+        }
+        start = end + 1;
+    }
+    printf("\n]}\n");
+}
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_BENCHHARNESS_H
@@ -0,0 +1,86 @@
+//
+// Worst case / tail latency of smalloc and sfree.
+// Built once per engine (ENGINE_NAME tells which one), all bookkeeping lives in mmapped memory
+// so nothing but the engine touches the heap while measuring.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <sys/mman.h>
+#include "Mymalloc.h"
+
+#ifndef ENGINE_NAME
+#define ENGINE_NAME "malloc_3"
+#endif
+#define NUM_OPS 1000000
+#define NUM_SLOTS 20000
+#define MAX_SMALL_SIZE 1024
+#define MAX_BIG_SIZE 65536
+
+/**
+ * Small xorshift generator - no allocations and the same sequence for every engine
+ */
+static uint64_t rng_state = 88172645463325252ULL;
+static uint64_t nextRandom() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void* mapArray(size_t bytes) {
+    void* addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return addr == MAP_FAILED ? nullptr : addr;
+}
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Sort the samples in place and print p50 / p99 / p99.99 / max
+ */
+static void report(const char* op, uint32_t* samples, size_t count) {
+    std::sort(samples, samples + count);
+    printf("%-10s %-8s %10zu %8u %8u %10u %10u\n", ENGINE_NAME, op, count,
+           samples[count / 2], samples[(size_t)(count * 0.99)],
+           samples[(size_t)(count * 0.9999)], samples[count - 1]);
+}
+
+int main() {
+    printf("%-10s %-8s %10s %8s %8s %10s %10s\n", "ENGINE", "OP", "COUNT", "P50 NS", "P99 NS", "P99.99 NS", "MAX NS");
+    void** slots = (void**)(mapArray(NUM_SLOTS * sizeof(void*)));
+    uint32_t* alloc_ns = (uint32_t*)(mapArray(NUM_OPS * sizeof(uint32_t)));
+    uint32_t* free_ns = (uint32_t*)(mapArray(NUM_OPS * sizeof(uint32_t)));
+    if(not slots or not alloc_ns or not free_ns) {
+        return 1;
+    }
+    size_t num_allocs = 0;
+    size_t num_frees = 0;
+    for (int i = 0 ; i < NUM_OPS ; ++i) {
+        size_t j = nextRandom() % NUM_SLOTS;
+        if(slots[j]) {
+            uint64_t start = nowNs();
+            sfree(slots[j]);
+            free_ns[num_frees++] = (uint32_t)(nowNs() - start);
+            slots[j] = nullptr;
+        }
+        else {
+            size_t size = (nextRandom() % 32 == 0) ? nextRandom() % MAX_BIG_SIZE + 1 : nextRandom() % MAX_SMALL_SIZE + 1;
+            uint64_t start = nowNs();
+            slots[j] = smalloc(size);
+            alloc_ns[num_allocs++] = (uint32_t)(nowNs() - start);
+            if(slots[j] == nullptr) {
+                fprintf(stderr, "smalloc(%zu) failed\n", size);
+                return 1;
+            }
+            *(char*)(slots[j]) = 1;
+        }
+    }
+    report("smalloc", alloc_ns, num_allocs);
+    report("sfree", free_ns, num_frees);
+    return 0;
+}
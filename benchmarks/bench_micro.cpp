@@ -0,0 +1,206 @@
+//
+// smalloc / sfree / srealloc / scalloc microbenchmarks: every engine (and glibc as the baseline) runs every
+// size distribution x allocation pattern x live heap size in a process of its own. Results are JSON on stdout -
+// latencies per operation, and hardware counters per operation for every phase of a run.
+//     bench_micro [--ops N] [--engines malloc_3,tlsf,glibc]
+//
+
+#include <cmath>
+#include <vector>
+#include "BenchHarness.h"
+
+#define DEFAULT_OPS 50000
+#define DEFAULT_ENGINES "malloc_1,malloc_2,malloc_3,malloc_4,glibc"
+#define FIXED_SIZE 64
+#define MAX_UNIFORM_SIZE 4096
+/* Power law (Pareto) sizes: most requests are tiny, a few are up to POWER_LAW_MAX_SIZE */
+#define POWER_LAW_MIN_SIZE 16
+#define POWER_LAW_MAX_SIZE 65536
+#define POWER_LAW_ALPHA 1.2
+#define SEED 42
+
+enum Distribution {
+    FIXED, UNIFORM, POWER_LAW, NUM_DISTRIBUTIONS
+};
+const char* distribution_names[] = {"fixed", "uniform", "power_law"};
+
+/* Which live object the churn frees before allocating a new one */
+enum Pattern {
+    LIFO, FIFO, RANDOM, NUM_PATTERNS
+};
+const char* pattern_names[] = {"lifo", "fifo", "random"};
+
+const size_t live_sizes[] = {256, 8192};
+
+/* Phases of a run, hardware counters are read around each */
+enum Phase {
+    FILL, CHURN, REALLOC, FREE_ALL, CALLOC, NUM_PHASES
+};
+const char* phase_names[] = {"fill", "churn", "realloc", "free_all", "calloc"};
+
+size_t nextSize(Distribution distribution, BenchRandom& random) {
+    switch (distribution) {
+        case FIXED:
+            return FIXED_SIZE;
+        case UNIFORM:
+            return random.next() % MAX_UNIFORM_SIZE + 1;
+        default: {
+            double size = POWER_LAW_MIN_SIZE / std::pow(1 - random.nextDouble(), 1 / POWER_LAW_ALPHA);
+            return (size_t)(std::min(size, (double)(POWER_LAW_MAX_SIZE)));
+        }
+    }
+}
+
+/**
+ * One configuration on one engine:
+ * fill the live set, churn ops times (free one live object by the pattern + allocate one),
+ * grow every live object with realloc, free everything, then calloc and free the live set again
+ * @return 0 on success, 1 if the engine ran out of memory or can't do an operation
+ */
+int runConfig(const BenchEngine& engine, Distribution distribution, Pattern pattern, size_t live, size_t ops, int fd) {
+    LatencySamples alloc_ns, free_ns, realloc_ns, calloc_ns;
+    void** objects = (void**)(benchMapArray(live * sizeof(void*)));
+    size_t* sizes = (size_t*)(benchMapArray(live * sizeof(size_t)));
+    if(not objects or not sizes or not alloc_ns.init(live + ops) or not free_ns.init(2 * live + ops) or
+       not realloc_ns.init(live) or not calloc_ns.init(live)) {
+        return 1;
+    }
+    BenchRandom random(SEED);
+    PerfCounters counters;
+    counters.open();
+    PerfSample phases[NUM_PHASES];
+    size_t phase_ops[NUM_PHASES] = {live, 2 * ops, live, live, live};
+    auto allocate = [&](size_t i) {
+        sizes[i] = nextSize(distribution, random);
+        uint64_t start = benchNowNs();
+        objects[i] = engine.allocate(sizes[i]);
+        alloc_ns.add(benchNowNs() - start);
+        if(objects[i]) {
+            *(char*)(objects[i]) = 1;
+        }
+        return objects[i] != nullptr;
+    };
+    auto release = [&](size_t i) {
+        uint64_t start = benchNowNs();
+        engine.release(objects[i]);
+        free_ns.add(benchNowNs() - start);
+        objects[i] = nullptr;
+    };
+
+    counters.start();
+    for (size_t i = 0; i < live; ++i) {
+        if(not allocate(i)) {
+            return 1;
+        }
+    }
+    phases[FILL] = counters.stop();
+    /* LIFO frees the newest object (the top slot), FIFO the oldest (a rotating slot) */
+    size_t oldest = 0;
+    counters.start();
+    for (size_t op = 0; op < ops; ++op) {
+        size_t i = live - 1;
+        if(pattern == FIFO) {
+            i = oldest;
+            oldest = (oldest + 1) % live;
+        }
+        else if(pattern == RANDOM) {
+            i = random.next() % live;
+        }
+        release(i);
+        if(not allocate(i)) {
+            return 1;
+        }
+    }
+    phases[CHURN] = counters.stop();
+    char fields[256];
+    snprintf(fields, sizeof(fields), "\"engine\": \"%s\", \"distribution\": \"%s\", \"pattern\": \"%s\", "
+                                     "\"live_objects\": %zu", engine.name, distribution_names[distribution],
+             pattern_names[pattern], live);
+    if(engine.reallocate and engine.zeroAllocate) {
+        counters.start();
+        for (size_t i = 0; i < live; ++i) {
+            sizes[i] += sizes[i] / 2;
+            uint64_t start = benchNowNs();
+            void* p = engine.reallocate(objects[i], sizes[i]);
+            realloc_ns.add(benchNowNs() - start);
+            if(p == nullptr) {
+                return 1;
+            }
+            objects[i] = p;
+        }
+        phases[REALLOC] = counters.stop();
+    }
+    counters.start();
+    for (size_t i = 0; i < live; ++i) {
+        release(i);
+    }
+    phases[FREE_ALL] = counters.stop();
+    if(engine.reallocate and engine.zeroAllocate) {
+        counters.start();
+        for (size_t i = 0; i < live; ++i) {
+            uint64_t start = benchNowNs();
+            objects[i] = engine.zeroAllocate(1, nextSize(distribution, random));
+            calloc_ns.add(benchNowNs() - start);
+            if(objects[i] == nullptr) {
+                return 1;
+            }
+        }
+        phases[CALLOC] = counters.stop();
+        for (size_t i = 0; i < live; ++i) {
+            release(i);
+        }
+    }
+    benchWriteRecord(fd, fields, "malloc", alloc_ns);
+    benchWriteRecord(fd, fields, "free", free_ns);
+    if(realloc_ns.count) {
+        benchWriteRecord(fd, fields, "realloc", realloc_ns);
+        benchWriteRecord(fd, fields, "calloc", calloc_ns);
+    }
+    for (int phase = 0; phase < NUM_PHASES; ++phase) {
+        if((phase != REALLOC and phase != CALLOC) or realloc_ns.count) {
+            benchWritePerf(fd, fields, phase_names[phase], phase_ops[phase], phases[phase]);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    size_t ops = DEFAULT_OPS;
+    std::string engines = DEFAULT_ENGINES;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "--ops") == 0) {
+            ops = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if(strcmp(argv[i], "--engines") == 0) {
+            engines = argv[i + 1];
+        }
+    }
+    std::vector<std::string> names;
+    for (size_t start = 0, end; start <= engines.size(); start = end + 1) {
+        end = std::min(engines.find(',', start), engines.size());
+        names.push_back(engines.substr(start, end - start));
+    }
+
+    std::string records;
+    for (const std::string& name : names) {
+        for (int distribution = 0; distribution < NUM_DISTRIBUTIONS; ++distribution) {
+            for (int pattern = 0; pattern < NUM_PATTERNS; ++pattern) {
+                for (size_t live : live_sizes) {
+                    bool ok = benchRunInChild([&](int fd) {
+                        BenchEngine engine;
+                        if(not benchSelectEngine(name.c_str(), &engine)) {
+                            return 1;
+                        }
+                        return runConfig(engine, (Distribution)(distribution), (Pattern)(pattern), live, ops, fd);
+                    }, records);
+                    if(not ok) {
+                        fprintf(stderr, "%s %s %s %zu: failed\n", name.c_str(), distribution_names[distribution],
+                                pattern_names[pattern], live);
+                    }
+                }
+            }
+        }
+    }
+    benchPrintJson("micro", records);
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+// Placement / split policy comparison for BlockMetaDataList.
+// Every heap layout gets its own reserved-region heap, so they can all run in one process.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "BlockMetaDataList.h"
+
+#define NUM_OPS 400000
+#define NUM_SLOTS 4096
+#define MAX_SMALL_SIZE 4000
+
+struct PolicyResult {
+    double ns_per_op;
+    size_t heap_bytes;
+    size_t free_bytes;
+    size_t free_blocks;
+};
+
+/**
+ * Random alloc/free churn over NUM_SLOTS live slots (mostly small sizes, some big ones that stay on the heap)
+ */
+template<class List>
+PolicyResult runPolicy(unsigned seed) {
+    static List list;
+    list.heap_backend = HEAP_BACKEND_RESERVED;
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> small_size(1, MAX_SMALL_SIZE);
+    std::uniform_int_distribution<size_t> big_size(MAX_SMALL_SIZE, 100000);
+    std::uniform_int_distribution<int> slot(0, NUM_SLOTS - 1);
+    std::vector<MallocMetaData*> slots(NUM_SLOTS, nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0 ; i < NUM_OPS ; ++i) {
+        int j = slot(rng);
+        if(slots[j]) {
+            list.freeBlock(slots[j]);
+            slots[j] = nullptr;
+        }
+        else {
+            size_t size = (rng() % 16 == 0) ? big_size(rng) : small_size(rng);
+            slots[j] = list.allocateBlock(size, DISABLE_WILDERNESS_EXTEND);
+            /* Touch the block like a real user would */
+            *((char*)(slots[j]) + sizeof(MallocMetaData)) = 1;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    PolicyResult result;
+    result.ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / NUM_OPS;
+    result.heap_bytes = list.reserved_region.used;
+    result.free_bytes = list.num_free_bytes;
+    result.free_blocks = list.num_free_blocks;
+    return result;
+}
+
+template<class List>
+void printPolicy(const char* name) {
+    PolicyResult result = runPolicy<List>(42);
+    printf("%-32s %10.1f %14zu %14zu %12zu\n", name, result.ns_per_op, result.heap_bytes,
+           result.free_bytes, result.free_blocks);
+}
+
+int main() {
+    printf("%-32s %10s %14s %14s %12s\n", "POLICY", "NS/OP", "HEAP BYTES", "FREE BYTES", "FREE BLOCKS");
+    printPolicy<BlockMetaDataList<BestFit>>("BestFit");
+    printPolicy<BlockMetaDataList<FirstFitAddressOrdered>>("FirstFitAddressOrdered");
+    printPolicy<BlockMetaDataList<NextFit>>("NextFit");
+    printPolicy<BlockMetaDataList<Lifo>>("Lifo");
+    printPolicy<BlockMetaDataList<BestFit, MinRemainderSplit<128>>>("BestFit, MinRemainderSplit<128>");
+    printPolicy<BlockMetaDataList<BestFit, MinRemainderSplit<1>, 32>>("BestFit, 32 bins");
+    return 0;
+}
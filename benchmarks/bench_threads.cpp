@@ -0,0 +1,352 @@
+//
+// Multi threaded scalability: the classic allocator workloads at 1..N threads, every engine (and glibc) in a
+// process of its own. Results are JSON on stdout - throughput per thread count, memory blowup
+// (peak RSS growth against the peak live bytes the workload asked for) and hardware counters per operation.
+//     bench_threads [--threads N] [--ops N] [--engines malloc_3,tlsf,glibc]
+//
+// The engines aren't thread safe, so their calls go through one lock (like the LD_PRELOAD shim does),
+// glibc is called directly.
+//
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BenchHarness.h"
+
+#define DEFAULT_OPS 200000
+#define DEFAULT_ENGINES "malloc_3,malloc_4,buddy,tlsf,glibc"
+#define MIN_SIZE 16
+#define MAX_SIZE 1024
+/* threadtest: every thread allocates and frees batches of fixed size objects */
+#define THREADTEST_BATCH 4096
+#define THREADTEST_SIZE 64
+/* larson: every thread replaces random objects of a slot array, the arrays move to another thread every round */
+#define LARSON_SLOTS 4096
+#define LARSON_ROUNDS 10
+/* producer / consumer: thread t allocates into ring t, thread t + 1 frees what comes out of it */
+#define RING_SIZE 1024
+#define SEED 42
+
+enum Workload {
+    THREADTEST, LARSON, PRODUCER_CONSUMER, NUM_WORKLOADS
+};
+const char* workload_names[] = {"threadtest", "larson", "producer_consumer"};
+
+/* The engine under test and the lock its calls take */
+static BenchEngine engine;
+static bool calls_locked = false;
+static std::mutex engine_lock;
+
+void* benchAllocate(size_t size) {
+    if(not calls_locked) {
+        return engine.allocate(size);
+    }
+    std::lock_guard<std::mutex> guard(engine_lock);
+    return engine.allocate(size);
+}
+
+void benchRelease(void* p) {
+    if(not calls_locked) {
+        engine.release(p);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(engine_lock);
+    engine.release(p);
+}
+
+/**
+ * This is what one thread did - padded so threads don't share its cache line
+ */
+struct alignas(64) ThreadResult {
+    uint64_t ops;
+    size_t peak_live_bytes;
+    bool failed;
+};
+
+/**
+ * All threads wait in wait() until the last one arrives
+ */
+class SpinBarrier {
+public:
+    explicit SpinBarrier(int threads) : threads(threads) {
+    }
+
+    void wait() {
+        int generation = this->generation.load();
+        if(arrived.fetch_add(1) + 1 == threads) {
+            arrived.store(0);
+            this->generation.fetch_add(1);
+            return;
+        }
+        while(this->generation.load() == generation) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    int threads;
+    std::atomic<int> arrived{0};
+    std::atomic<int> generation{0};
+};
+
+/**
+ * This is a single producer single consumer ring of allocated objects
+ */
+struct alignas(64) Ring {
+    void* objects[RING_SIZE];
+    size_t sizes[RING_SIZE];
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    /* Bytes the consumer freed - the producer's live bytes are what it allocated minus this */
+    std::atomic<size_t> freed_bytes;
+};
+
+size_t randomSize(BenchRandom& random) {
+    return MIN_SIZE + random.next() % (MAX_SIZE - MIN_SIZE + 1);
+}
+
+void* touch(void* p) {
+    if(p) {
+        *(char*)(p) = 1;
+    }
+    return p;
+}
+
+void threadTest(size_t ops, ThreadResult& result) {
+    void** objects = (void**)(benchMapArray(THREADTEST_BATCH * sizeof(void*)));
+    if(objects == nullptr) {
+        result.failed = true;
+        return;
+    }
+    for (size_t done = 0; done < ops; done += 2 * THREADTEST_BATCH) {
+        for (size_t i = 0; i < THREADTEST_BATCH; ++i) {
+            if((objects[i] = touch(benchAllocate(THREADTEST_SIZE))) == nullptr) {
+                result.failed = true;
+                return;
+            }
+        }
+        for (size_t i = 0; i < THREADTEST_BATCH; ++i) {
+            benchRelease(objects[i]);
+        }
+        result.ops += 2 * THREADTEST_BATCH;
+    }
+    result.peak_live_bytes = THREADTEST_BATCH * THREADTEST_SIZE;
+    munmap(objects, THREADTEST_BATCH * sizeof(void*));
+}
+
+/**
+ * Slot array of a larson thread - sizes[i] is 0 for an empty slot
+ */
+struct LarsonArray {
+    void** objects;
+    size_t* sizes;
+    size_t live_bytes;
+    size_t peak_live_bytes;
+};
+
+/**
+ * Round r works on array (thread + r) % threads, so most objects are freed by a thread other than the one
+ * that allocated them
+ */
+void larson(int thread, int threads, size_t ops, LarsonArray* arrays, SpinBarrier& barrier, ThreadResult& result) {
+    BenchRandom random(SEED + thread);
+    size_t ops_per_round = ops / LARSON_ROUNDS;
+    for (int round = 0; round < LARSON_ROUNDS; ++round) {
+        LarsonArray& array = arrays[(thread + round) % threads];
+        for (size_t op = 0; op < ops_per_round and not result.failed; op += 2) {
+            size_t i = random.next() % LARSON_SLOTS;
+            if(array.sizes[i]) {
+                benchRelease(array.objects[i]);
+                array.live_bytes -= array.sizes[i];
+            }
+            array.sizes[i] = randomSize(random);
+            if((array.objects[i] = touch(benchAllocate(array.sizes[i]))) == nullptr) {
+                array.sizes[i] = 0;
+                result.failed = true;
+            }
+            array.live_bytes += array.sizes[i];
+            array.peak_live_bytes = std::max(array.peak_live_bytes, array.live_bytes);
+            result.ops += 2;
+        }
+        barrier.wait();
+    }
+}
+
+/**
+ * Thread t fills rings[t] and empties the ring of the thread before it, until ops objects went each way
+ */
+void producerConsumer(int thread, int threads, size_t ops, Ring* rings, ThreadResult& result) {
+    Ring& out = rings[thread];
+    Ring& in = rings[(thread + threads - 1) % threads];
+    BenchRandom random(SEED + thread);
+    size_t produced = 0, consumed = 0, allocated_bytes = 0, freed_bytes = 0;
+    while(produced < ops or consumed < ops) {
+        size_t tail = out.tail.load(std::memory_order_relaxed);
+        while(produced < ops and tail - out.head.load(std::memory_order_acquire) < RING_SIZE) {
+            size_t size = randomSize(random);
+            void* p = touch(benchAllocate(size));
+            if(p == nullptr) {
+                result.failed = true;
+                return;
+            }
+            out.objects[tail % RING_SIZE] = p;
+            out.sizes[tail % RING_SIZE] = size;
+            out.tail.store(++tail, std::memory_order_release);
+            produced++;
+            allocated_bytes += size;
+            result.peak_live_bytes = std::max(result.peak_live_bytes,
+                                              allocated_bytes - out.freed_bytes.load(std::memory_order_relaxed));
+        }
+        size_t head = in.head.load(std::memory_order_relaxed);
+        while(head != in.tail.load(std::memory_order_acquire)) {
+            benchRelease(in.objects[head % RING_SIZE]);
+            freed_bytes += in.sizes[head % RING_SIZE];
+            in.freed_bytes.store(freed_bytes, std::memory_order_relaxed);
+            in.head.store(++head, std::memory_order_release);
+            consumed++;
+        }
+        if(produced == ops and consumed < ops) {
+            std::this_thread::yield();
+        }
+    }
+    result.ops = 2 * ops;
+}
+
+/**
+ * Size of a /proc/self/status field (VmRSS, VmHWM) in bytes, 0 if it can't be read
+ */
+size_t procStatusBytes(const char* field) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if(status == nullptr) {
+        return 0;
+    }
+    char line[256];
+    size_t kb = 0;
+    size_t length = strlen(field);
+    while(fgets(line, sizeof(line), status)) {
+        if(strncmp(line, field, length) == 0 and line[length] == ':') {
+            kb = strtoul(line + length + 1, nullptr, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return kb * 1024;
+}
+
+/**
+ * One workload at one thread count on the selected engine, run in a child of its own
+ * @return 0 on success, 1 if the engine ran out of memory
+ */
+int runWorkload(Workload workload, int threads, size_t ops, int fd) {
+    ThreadResult* results = (ThreadResult*)(benchMapArray(threads * sizeof(ThreadResult)));
+    LarsonArray* arrays = (LarsonArray*)(benchMapArray(threads * sizeof(LarsonArray)));
+    Ring* rings = (Ring*)(benchMapArray(threads * sizeof(Ring)));
+    if(not results or not arrays or not rings) {
+        return 1;
+    }
+    for (int t = 0; t < threads; ++t) {
+        arrays[t].objects = (void**)(benchMapArray(LARSON_SLOTS * sizeof(void*)));
+        arrays[t].sizes = (size_t*)(benchMapArray(LARSON_SLOTS * sizeof(size_t)));
+        if(not arrays[t].objects or not arrays[t].sizes) {
+            return 1;
+        }
+    }
+    SpinBarrier barrier(threads);
+    /* Inherited, so the workers are counted too */
+    PerfCounters counters;
+    counters.open(true);
+    size_t base_rss = procStatusBytes("VmRSS");
+    counters.start();
+    uint64_t start = benchNowNs();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            switch (workload) {
+                case THREADTEST:
+                    threadTest(ops, results[t]);
+                    break;
+                case LARSON:
+                    larson(t, threads, ops, arrays, barrier, results[t]);
+                    break;
+                default:
+                    producerConsumer(t, threads, ops, rings, results[t]);
+                    break;
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    uint64_t elapsed_ns = benchNowNs() - start;
+    PerfSample sample = counters.stop();
+    size_t peak_rss = procStatusBytes("VmHWM");
+
+    uint64_t total_ops = 0;
+    size_t peak_live_bytes = 0;
+    for (int t = 0; t < threads; ++t) {
+        if(results[t].failed) {
+            return 1;
+        }
+        total_ops += results[t].ops;
+        peak_live_bytes += workload == LARSON ? arrays[t].peak_live_bytes : results[t].peak_live_bytes;
+    }
+    size_t rss_growth = peak_rss > base_rss ? peak_rss - base_rss : 0;
+    dprintf(fd, "{\"engine\": \"%s\", \"workload\": \"%s\", \"threads\": %d, \"ops\": %llu, \"ops_per_sec\": %.0f, "
+                "\"peak_live_bytes\": %zu, \"rss_growth_bytes\": %zu, \"blowup\": %.2f, %s}\n",
+            engine.name, workload_names[workload], threads, (unsigned long long)(total_ops),
+            elapsed_ns ? total_ops * 1e9 / elapsed_ns : 0, peak_live_bytes, rss_growth,
+            peak_live_bytes ? (double)(rss_growth) / peak_live_bytes : 0, benchFormatPerf(sample, total_ops).c_str());
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int max_threads = (int)(std::thread::hardware_concurrency());
+    size_t ops = DEFAULT_OPS;
+    std::string engines = DEFAULT_ENGINES;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "--threads") == 0) {
+            max_threads = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "--ops") == 0) {
+            ops = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if(strcmp(argv[i], "--engines") == 0) {
+            engines = argv[i + 1];
+        }
+    }
+    if(max_threads < 1) {
+        max_threads = 1;
+    }
+    /* 1, 2, 4, ... and max_threads itself */
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+    std::vector<std::string> names;
+    for (size_t start = 0, end; start <= engines.size(); start = end + 1) {
+        end = std::min(engines.find(',', start), engines.size());
+        names.push_back(engines.substr(start, end - start));
+    }
+
+    std::string records;
+    for (const std::string& name : names) {
+        for (int workload = 0; workload < NUM_WORKLOADS; ++workload) {
+            for (int threads : thread_counts) {
+                bool ok = benchRunInChild([&](int fd) {
+                    if(not benchSelectEngine(name.c_str(), &engine)) {
+                        return 1;
+                    }
+                    calls_locked = name != "glibc";
+                    return runWorkload((Workload)(workload), threads, ops, fd);
+                }, records);
+                if(not ok) {
+                    fprintf(stderr, "%s %s %d threads: failed\n", name.c_str(), workload_names[workload], threads);
+                }
+            }
+        }
+    }
+    benchPrintJson("threads", records);
+    return 0;
+}
@@ -1,4 +1,7 @@
 #include <unistd.h>
+#include "SmallocEngine.h"
+
+SMALLOC_ENGINE_BEGIN
 
 /**
  * This is a Naive malloc - it doesnt do anything smart.
@@ -17,4 +20,6 @@ void* smalloc(size_t size) {
     }
     /* Giving user a pointer to the newly allocated space. */
     return data_address;
-}
\ No newline at end of file
+}
+
+SMALLOC_ENGINE_END
@@ -1,5 +1,8 @@
 #include <unistd.h>
 #include <cstring>
+#include "SmallocEngine.h"
+
+SMALLOC_ENGINE_BEGIN
 /**
  * This is a metadata used to manage the allocated blocks in a linked list
  */
@@ -176,6 +179,19 @@ void* srealloc(void* oldp, size_t new_size) {
     return newp;
 }
 
+/**
+ * Usable bytes of an allocated block (like malloc_usable_size), may be more than was asked for
+ * @param p
+ * @return 0 for nullptr
+ */
+size_t smalloc_usable_size(void* p) {
+    if(p == nullptr) {
+        return 0;
+    }
+    char* p1 = (char*)(p);
+    return ((MallocMetaData*)(p1 - sizeof(MallocMetaData)))->size;
+}
+
 size_t _num_free_blocks() {
     return meta_list.num_free_blocks;
 }
@@ -199,3 +215,5 @@ size_t _size_meta_data() {
 size_t _num_meta_data_bytes() {
     return meta_list.total_blocks * _size_meta_data();
 }
+
+SMALLOC_ENGINE_END
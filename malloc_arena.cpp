@@ -0,0 +1,165 @@
+#include <cstdint>
+#include "Mymalloc.h"
+
+/* Chunk size when sarena_create() is given 0, and the alignment of every arena allocation */
+#define SARENA_DEFAULT_CHUNK ((size_t)(64 * 1024))
+#define SARENA_ALIGNMENT ((size_t)16)
+
+/**
+ * This is a chunk of an arena - a block from smalloc() that is bump allocated from top to end
+ */
+struct SArenaChunk {
+    SArenaChunk* next;
+    char* top;
+    char* end;
+};
+
+/**
+ * This is an arena - it lives at the start of its first chunk.
+ * Chunks stay chained after a reset / restore and are reused in order, only sarena_destroy() frees them.
+ */
+struct SArena {
+    SArenaChunk* first;
+    SArenaChunk* current;
+    size_t chunk_size;
+};
+
+/* Largest allocation - a bigger one would overflow its rounding or the size of its chunk */
+#define SARENA_MAX_ALLOC (SIZE_MAX - sizeof(SArenaChunk) - 2 * SARENA_ALIGNMENT)
+
+static char* alignUp(char* p) {
+    return (char*)(((uintptr_t)(p) + SARENA_ALIGNMENT - 1) & ~(SARENA_ALIGNMENT - 1));
+}
+
+/**
+ * smalloc a chunk with room for at least size bytes (after aligning), size is at most SARENA_MAX_ALLOC
+ * @return nullptr if smalloc fails
+ */
+static SArenaChunk* newChunk(size_t chunk_size, size_t size) {
+    size_t bytes = sizeof(SArenaChunk) + size + SARENA_ALIGNMENT;
+    if(bytes < chunk_size) {
+        bytes = chunk_size;
+    }
+    /* An unaligned chunk would leave the engine's next block unaligned */
+    if(bytes > SIZE_MAX - SARENA_ALIGNMENT) {
+        return nullptr;
+    }
+    bytes = (bytes + SARENA_ALIGNMENT - 1) & ~(SARENA_ALIGNMENT - 1);
+    SArenaChunk* chunk = (SArenaChunk*)(smalloc(bytes));
+    if(chunk == nullptr) {
+        return nullptr;
+    }
+    chunk->next = nullptr;
+    chunk->top = alignUp((char*)(chunk) + sizeof(SArenaChunk));
+    chunk->end = (char*)(chunk) + bytes;
+    return chunk;
+}
+
+/**
+ * Where a chunk's allocations start
+ */
+static char* chunkStart(SArena* arena, SArenaChunk* chunk) {
+    char* start = (char*)(chunk) + sizeof(SArenaChunk);
+    if(chunk == arena->first) {
+        start += sizeof(SArena);
+    }
+    return alignUp(start);
+}
+
+/**
+ * Create an arena for many small allocations that are all freed together
+ * @param chunk_size bytes taken from smalloc() at a time (0 - SARENA_DEFAULT_CHUNK)
+ * @return nullptr if smalloc fails
+ */
+SArena* sarena_create(size_t chunk_size) {
+    if(chunk_size == 0) {
+        chunk_size = SARENA_DEFAULT_CHUNK;
+    }
+    SArenaChunk* chunk = newChunk(chunk_size, sizeof(SArena) + SARENA_ALIGNMENT);
+    if(chunk == nullptr) {
+        return nullptr;
+    }
+    SArena* arena = (SArena*)((char*)(chunk) + sizeof(SArenaChunk));
+    arena->first = arena->current = chunk;
+    arena->chunk_size = chunk_size;
+    chunk->top = chunkStart(arena, chunk);
+    return arena;
+}
+
+/**
+ * Bump allocate size bytes (SARENA_ALIGNMENT aligned) - moves on to the next chunk when the current one is full
+ * @param arena
+ * @param size
+ * @return nullptr if size is 0 or above SARENA_MAX_ALLOC or a new chunk can't be allocated
+ */
+void* sarena_alloc(SArena* arena, size_t size) {
+    if(size == 0 or size > SARENA_MAX_ALLOC) {
+        return nullptr;
+    }
+    size = (size + SARENA_ALIGNMENT - 1) & ~(SARENA_ALIGNMENT - 1);
+    SArenaChunk* chunk = arena->current;
+    if((size_t)(chunk->end - chunk->top) < size) {
+        /* Reuse the next chunk (kept from before a reset) if it is big enough, otherwise put a new one before it */
+        SArenaChunk* next = chunk->next;
+        if(next and (size_t)(next->end - chunkStart(arena, next)) >= size) {
+            next->top = chunkStart(arena, next);
+        }
+        else {
+            next = newChunk(arena->chunk_size, size);
+            if(next == nullptr) {
+                return nullptr;
+            }
+            next->next = chunk->next;
+            chunk->next = next;
+        }
+        arena->current = chunk = next;
+    }
+    void* p = chunk->top;
+    chunk->top += size;
+    return p;
+}
+
+/**
+ * Current position of the arena - sarena_restore() frees everything allocated after it
+ */
+SArenaMarker sarena_save(SArena* arena) {
+    SArenaMarker marker;
+    marker.chunk = arena->current;
+    marker.top = arena->current->top;
+    return marker;
+}
+
+/**
+ * Free (in O(1)) everything allocated since marker was saved, markers saved after it become invalid
+ * @param arena
+ * @param marker
+ */
+void sarena_restore(SArena* arena, SArenaMarker marker) {
+    arena->current = (SArenaChunk*)(marker.chunk);
+    arena->current->top = marker.top;
+}
+
+/**
+ * Free (in O(1)) everything allocated from the arena, its chunks are kept for the next allocations
+ * @param arena
+ */
+void sarena_reset(SArena* arena) {
+    arena->current = arena->first;
+    arena->first->top = chunkStart(arena, arena->first);
+}
+
+/**
+ * Give all the arena's chunks back to the heap
+ * @param arena
+ */
+void sarena_destroy(SArena* arena) {
+    if(arena == nullptr) {
+        return;
+    }
+    SArenaChunk* chunk = arena->first;
+    while(chunk) {
+        SArenaChunk* next = chunk->next;
+        sfree(chunk);
+        chunk = next;
+    }
+}
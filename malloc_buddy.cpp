@@ -0,0 +1,407 @@
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <sys/mman.h>
+#include <algorithm>
+#include "SmallocEngine.h"
+
+SMALLOC_ENGINE_BEGIN
+
+/* Blocks are 2^MIN_ORDER .. 2^MAX_ORDER bytes (header included), bigger requests are mmapped like in malloc_3 */
+#define MIN_ORDER 5
+#define MAX_ORDER 17
+#define NUM_ORDERS (MAX_ORDER - MIN_ORDER + 1)
+#define MMAP_ORDER 0xFF
+/* Header right before an smemalign() payload, its size is the distance back to the block's real header */
+#define ALIGNED_ORDER 0xFE
+/* Header of a block that was merged into a bigger one - no longer a block, a stale free of it is ignored */
+#define MERGED_ORDER 0xFD
+#define MMAP_THRESHOLD ((size_t)(128e3))
+/* Top level (MAX_ORDER) blocks are committed one at a time out of a reserved arena */
+#define BUDDY_ARENA_SIZE ((size_t)(4) * 1024 * 1024 * 1024)
+#define TOP_BLOCK_SIZE ((size_t)(1) << MAX_ORDER)
+#define BITS_PER_WORD (8 * sizeof(size_t))
+
+/**
+ * This is a metadata at the start of every buddy block
+ */
+struct BuddyMetaData {
+    size_t size;
+    unsigned char order;
+    bool is_free;
+    BuddyMetaData* next;
+    BuddyMetaData* prev;
+};
+
+/**
+ * This is a binary buddy allocator: a block of order k splits into two buddies of order k - 1,
+ * a block's buddy is found by XORing its offset in the arena with 2^k, and per order free-area bitmaps
+ * (bit offset >> k is set while that block is free) tell in O(1) if the buddy can be merged with.
+ */
+class BuddyAllocator {
+public:
+    char* arena = nullptr;
+    size_t arena_top = 0;
+    BuddyMetaData* free_list[NUM_ORDERS] = {};
+    size_t* free_map[NUM_ORDERS] = {};
+    /* Bit i is set if free_list[i] is not empty */
+    size_t nonempty_orders = 0;
+    size_t num_free_bytes = 0;
+    size_t num_free_blocks = 0;
+    size_t total_bytes = 0;
+    size_t total_blocks = 0;
+    bool init();
+    bool addTopBlock();
+    BuddyMetaData* allocateBlock(size_t size);
+    void freeBlock(BuddyMetaData* block);
+    void pushFree(BuddyMetaData* block, int order);
+    void removeFree(BuddyMetaData* block, int order);
+    bool isFree(size_t offset, int order) const;
+    void setFree(size_t offset, int order, bool is_free);
+    static int orderOf(size_t size);
+    static size_t capacity(int order);
+};
+
+/**
+ * Reserve the arena and the (lazily committed) free-area bitmaps
+ * @return false if mmap fails
+ */
+bool BuddyAllocator::init() {
+    void* addr = mmap(NULL, BUDDY_ARENA_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    for (int i = 0; i < NUM_ORDERS; ++i) {
+        size_t bits = BUDDY_ARENA_SIZE >> (i + MIN_ORDER);
+        void* map = mmap(NULL, bits / 8, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(map == MAP_FAILED) {
+            return false;
+        }
+        free_map[i] = (size_t*)(map);
+    }
+    arena = (char*)(addr);
+    return true;
+}
+
+/**
+ * Commit the next MAX_ORDER block of the arena and add it to the free lists
+ * @return false if the arena is exhausted or can't be committed
+ */
+bool BuddyAllocator::addTopBlock() {
+    if(arena == nullptr and not init()) {
+        return false;
+    }
+    if(arena_top + TOP_BLOCK_SIZE > BUDDY_ARENA_SIZE) {
+        return false;
+    }
+    if(mprotect(arena + arena_top, TOP_BLOCK_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    BuddyMetaData* block = (BuddyMetaData*)(arena + arena_top);
+    arena_top += TOP_BLOCK_SIZE;
+    total_blocks++;
+    total_bytes += capacity(MAX_ORDER);
+    num_free_blocks++;
+    num_free_bytes += capacity(MAX_ORDER);
+    pushFree(block, MAX_ORDER);
+    return true;
+}
+
+/**
+ * Smallest order that holds size bytes and the header
+ */
+int BuddyAllocator::orderOf(size_t size) {
+    int order = MIN_ORDER;
+    while(capacity(order) < size) {
+        order++;
+    }
+    return order;
+}
+
+/**
+ * Usable bytes in a block of this order
+ */
+size_t BuddyAllocator::capacity(int order) {
+    return ((size_t)(1) << order) - sizeof(BuddyMetaData);
+}
+
+bool BuddyAllocator::isFree(size_t offset, int order) const {
+    size_t bit = offset >> order;
+    return free_map[order - MIN_ORDER][bit / BITS_PER_WORD] & ((size_t)(1) << (bit % BITS_PER_WORD));
+}
+
+void BuddyAllocator::setFree(size_t offset, int order, bool is_free) {
+    size_t bit = offset >> order;
+    size_t mask = (size_t)(1) << (bit % BITS_PER_WORD);
+    if(is_free) {
+        free_map[order - MIN_ORDER][bit / BITS_PER_WORD] |= mask;
+    }
+    else {
+        free_map[order - MIN_ORDER][bit / BITS_PER_WORD] &= ~mask;
+    }
+}
+
+void BuddyAllocator::pushFree(BuddyMetaData *block, int order) {
+    int i = order - MIN_ORDER;
+    block->order = (unsigned char)(order);
+    block->is_free = true;
+    block->prev = nullptr;
+    block->next = free_list[i];
+    if(free_list[i]) {
+        free_list[i]->prev = block;
+    }
+    free_list[i] = block;
+    nonempty_orders |= (size_t)(1) << i;
+    setFree((char*)(block) - arena, order, true);
+}
+
+void BuddyAllocator::removeFree(BuddyMetaData *block, int order) {
+    int i = order - MIN_ORDER;
+    if(block->prev) {
+        block->prev->next = block->next;
+    }
+    else {
+        free_list[i] = block->next;
+    }
+    if(block->next) {
+        block->next->prev = block->prev;
+    }
+    if(free_list[i] == nullptr) {
+        nonempty_orders &= ~((size_t)(1) << i);
+    }
+    block->is_free = false;
+    setFree((char*)(block) - arena, order, false);
+}
+
+/**
+ * Take the smallest free block of a big enough order and split it down to the needed order
+ * @param size
+ * @return nullptr if size is 0 / bigger than 1e8 or memory can't be added
+ */
+BuddyMetaData *BuddyAllocator::allocateBlock(size_t size) {
+    if(size == 0 or size > 1e8) {
+        return nullptr;
+    }
+    if(size > MMAP_THRESHOLD) {
+        void* addr = mmap(NULL, sizeof(BuddyMetaData) + size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED) {
+            return nullptr;
+        }
+        BuddyMetaData* block = (BuddyMetaData*)(addr);
+        block->size = size;
+        block->order = MMAP_ORDER;
+        block->is_free = false;
+        total_blocks++;
+        total_bytes += size;
+        return block;
+    }
+    int order = orderOf(size);
+    /* Lowest non empty order >= order */
+    size_t candidates = nonempty_orders & ~(((size_t)(1) << (order - MIN_ORDER)) - 1);
+    if(candidates == 0) {
+        if(not addTopBlock()) {
+            return nullptr;
+        }
+        candidates = nonempty_orders & ~(((size_t)(1) << (order - MIN_ORDER)) - 1);
+    }
+    int found = __builtin_ctzl(candidates) + MIN_ORDER;
+    BuddyMetaData* block = free_list[found - MIN_ORDER];
+    removeFree(block, found);
+    num_free_blocks--;
+    num_free_bytes -= capacity(found);
+    /* Split - every split leaves the upper half free */
+    while(found > order) {
+        found--;
+        BuddyMetaData* buddy = (BuddyMetaData*)((char*)(block) + ((size_t)(1) << found));
+        pushFree(buddy, found);
+        total_blocks++;
+        total_bytes += capacity(found) + capacity(found) - capacity(found + 1);
+        num_free_blocks++;
+        num_free_bytes += capacity(found);
+    }
+    block->order = (unsigned char)(order);
+    block->size = size;
+    return block;
+}
+
+/**
+ * Free a block and merge it with its buddy for as long as the buddy is free
+ * @param block ignored if it is free or was merged into another block already (double free)
+ */
+void BuddyAllocator::freeBlock(BuddyMetaData *block) {
+    if(block->is_free or block->order == MERGED_ORDER) {
+        return;
+    }
+    if(block->order == MMAP_ORDER) {
+        total_blocks--;
+        total_bytes -= block->size;
+        munmap(block, sizeof(BuddyMetaData) + block->size);
+        return;
+    }
+    int order = block->order;
+    size_t offset = (char*)(block) - arena;
+    num_free_blocks++;
+    num_free_bytes += capacity(order);
+    while(order < MAX_ORDER) {
+        size_t buddy_offset = offset ^ ((size_t)(1) << order);
+        if(not isFree(buddy_offset, order)) {
+            break;
+        }
+        BuddyMetaData* buddy = (BuddyMetaData*)(arena + buddy_offset);
+        removeFree(buddy, order);
+        /* Neither header starts a block any more (pushFree rewrites the one of the merged block) */
+        buddy->order = MERGED_ORDER;
+        ((BuddyMetaData*)(arena + offset))->order = MERGED_ORDER;
+        /* Two blocks of order become one of order + 1 */
+        total_blocks--;
+        total_bytes += capacity(order + 1) - capacity(order) - capacity(order);
+        num_free_blocks--;
+        num_free_bytes += capacity(order + 1) - capacity(order) - capacity(order);
+        offset &= ~((size_t)(1) << order);
+        order++;
+    }
+    pushFree((BuddyMetaData*)(arena + offset), order);
+}
+
+BuddyAllocator buddy_allocator;
+
+/**
+ * Header of the block p was allocated from (skipping an smemalign() forwarding header)
+ */
+BuddyMetaData* headerOf(void* p) {
+    BuddyMetaData* block = (BuddyMetaData*)((char*)(p) - sizeof(BuddyMetaData));
+    if(block->order == ALIGNED_ORDER) {
+        block = (BuddyMetaData*)((char*)(block) - block->size);
+    }
+    return block;
+}
+
+/**
+ * Bytes between the end of p's real header and p (0 unless p came from smemalign())
+ */
+size_t payloadOffset(void* p) {
+    return (char*)(p) - (char*)(headerOf(p)) - sizeof(BuddyMetaData);
+}
+
+void* smalloc(size_t size) {
+    BuddyMetaData* block = buddy_allocator.allocateBlock(size);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    return (void*)((char*)(block) + sizeof(BuddyMetaData));
+}
+
+void* scalloc(size_t num, size_t size) {
+    if(size != 0 and num > (size_t)(1e8) / size) {
+        return nullptr;
+    }
+    void* block = smalloc(num * size);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    /* Making a zeroes block */
+    memset(block, 0, num * size);
+    return block;
+}
+
+void sfree(void* p) {
+    if(p == nullptr) {
+        return;
+    }
+    buddy_allocator.freeBlock(headerOf(p));
+}
+
+void* srealloc(void* oldp, size_t new_size) {
+    if(oldp == nullptr) {
+        return smalloc(new_size);
+    }
+    if(new_size == 0 or new_size > 1e8) {
+        return nullptr;
+    }
+    BuddyMetaData* block = headerOf(oldp);
+    size_t offset = payloadOffset(oldp);
+    /* A. The block is already big enough */
+    if(block->order != MMAP_ORDER and offset + new_size <= BuddyAllocator::capacity(block->order)) {
+        block->size = offset + new_size;
+        return oldp;
+    }
+    /* B. Move to a new block */
+    void* newp = smalloc(new_size);
+    if(newp == nullptr) {
+        return nullptr;
+    }
+    memcpy(newp, oldp, std::min(block->size - offset, new_size));
+    sfree(oldp);
+    return newp;
+}
+
+/**
+ * Allocate size bytes at an address that is a multiple of alignment (like memalign).
+ * The block is over-allocated and a forwarding header in front of the aligned payload points back to it.
+ * @param alignment power of two
+ * @param size
+ * @return nullptr on a bad alignment / size or if there is no memory
+ */
+void* smemalign(size_t alignment, size_t size) {
+    if(alignment == 0 or (alignment & (alignment - 1)) != 0 or size == 0 or size > 1e8) {
+        return nullptr;
+    }
+    /* Blocks (and mappings) are at least header size aligned */
+    if(alignment <= sizeof(BuddyMetaData)) {
+        return smalloc(size);
+    }
+    BuddyMetaData* block = buddy_allocator.allocateBlock(size + alignment + sizeof(BuddyMetaData));
+    if(block == nullptr) {
+        return nullptr;
+    }
+    /* Room for the forwarding header between the real header and the payload */
+    uintptr_t payload = (uintptr_t)(block) + 2 * sizeof(BuddyMetaData);
+    payload = (payload + alignment - 1) & ~(alignment - 1);
+    BuddyMetaData* forward = (BuddyMetaData*)(payload - sizeof(BuddyMetaData));
+    forward->size = (char*)(forward) - (char*)(block);
+    forward->order = ALIGNED_ORDER;
+    forward->is_free = false;
+    return (void*)(payload);
+}
+
+/**
+ * Usable bytes of an allocated block (like malloc_usable_size), may be more than was asked for
+ * @param p
+ * @return 0 for nullptr
+ */
+size_t smalloc_usable_size(void* p) {
+    if(p == nullptr) {
+        return 0;
+    }
+    BuddyMetaData* block = headerOf(p);
+    size_t capacity = block->order == MMAP_ORDER ? block->size : BuddyAllocator::capacity(block->order);
+    return capacity - payloadOffset(p);
+}
+
+size_t _num_free_blocks() {
+    return buddy_allocator.num_free_blocks;
+}
+
+size_t _num_free_bytes() {
+    return buddy_allocator.num_free_bytes;
+}
+
+size_t _num_allocated_blocks() {
+    return buddy_allocator.total_blocks;
+}
+
+size_t _num_allocated_bytes() {
+    return buddy_allocator.total_bytes;
+}
+
+size_t _size_meta_data() {
+    return sizeof(BuddyMetaData);
+}
+
+size_t _num_meta_data_bytes() {
+    return buddy_allocator.total_blocks * _size_meta_data();
+}
+
+SMALLOC_ENGINE_END
@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <cstring>
+#include "SmallocCounters.h"
+#include "Mymalloc.h"
+
+/**
+ * Add up every thread's path counters and latency histograms (see SmallocCounters.h)
+ * @param out
+ * @return 1, or 0 (out zeroed) if the engines were built without SMALLOC_STATS
+ */
+int scounters_snapshot(SCounters* out) {
+    memset(out, 0, sizeof(*out));
+#ifdef SMALLOC_STATS
+    for (SCountersThread* thread = scountersThreads().load(); thread; thread = thread->next) {
+        for (int i = 0; i < SCOUNT_NUM_COUNTERS; ++i) {
+            out->counters[i] += thread->counters[i].load(std::memory_order_relaxed);
+        }
+        for (int op = 0; op < SCOUNT_NUM_OPS; ++op) {
+            for (int bucket = 0; bucket < SCOUNT_BUCKETS; ++bucket) {
+                out->latency[op][bucket] += thread->latency[op][bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Print the counters that aren't 0 and the latency histograms of the timed calls
+ * @param fd
+ */
+void scounters_print(int fd) {
+    SCounters counters;
+    if(not scounters_snapshot(&counters)) {
+        dprintf(fd, "counters compiled out (build with SMALLOC_STATS)\n");
+        return;
+    }
+    for (int i = 0; i < SCOUNT_NUM_COUNTERS; ++i) {
+        if(counters.counters[i]) {
+            dprintf(fd, "%-24s %llu\n", scounterName(i), counters.counters[i]);
+        }
+    }
+    for (int op = 0; op < SCOUNT_NUM_OPS; ++op) {
+        for (int bucket = 0; bucket < SCOUNT_BUCKETS; ++bucket) {
+            if(counters.latency[op][bucket]) {
+                dprintf(fd, "%-10s < %20llu ticks %llu\n", scountedOpName(op), 1ULL << bucket,
+                        counters.latency[op][bucket]);
+            }
+        }
+    }
+}
@@ -0,0 +1,298 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include "SmallocEngine.h"
+#include "STrace.h"
+#include "SProfile.h"
+#include "Mymalloc.h"
+
+/* Engine used when neither sengine_select() nor SMALLOC_ENGINE picks one */
+#define DEFAULT_ENGINE "malloc_3"
+
+/* Every engine is compiled into its own namespace (see SmallocEngine.h) */
+#define DECLARE_ENGINE(ns) \
+namespace ns { \
+    void* smalloc(size_t size); \
+    void* scalloc(size_t num, size_t size); \
+    void sfree(void* p); \
+    void* srealloc(void* oldp, size_t new_size); \
+    size_t smalloc_usable_size(void* p); \
+    size_t _num_free_blocks(); \
+    size_t _num_free_bytes(); \
+    size_t _num_allocated_blocks(); \
+    size_t _num_allocated_bytes(); \
+    size_t _size_meta_data(); \
+    size_t _num_meta_data_bytes(); \
+    void* smemalign(size_t alignment, size_t size); \
+    int smallopt(int param, size_t value); \
+    int sreserve(size_t bytes, int flags); \
+    int sprefill(size_t size, size_t count, int flags); \
+    size_t _num_sbrk_calls(); \
+    size_t _num_sbrk_calls_saved(); \
+    int sheap_stats(SHeapStats* stats); \
+    int sheap_snapshot(int fd); \
+    int sheap_iterate(SHeapVisitor visitor, void* ctx); \
+}
+#define ENGINE_API(ns) ns::smalloc, ns::scalloc, ns::sfree, ns::srealloc, ns::smalloc_usable_size, ns::smemalign, \
+    ns::_num_free_blocks, ns::_num_free_bytes, ns::_num_allocated_blocks, ns::_num_allocated_bytes, \
+    ns::_size_meta_data, ns::_num_meta_data_bytes
+
+DECLARE_ENGINE(malloc_1)
+DECLARE_ENGINE(malloc_2)
+DECLARE_ENGINE(malloc_3)
+DECLARE_ENGINE(malloc_4)
+DECLARE_ENGINE(malloc_buddy)
+DECLARE_ENGINE(malloc_tlsf)
+
+const SmallocEngine engines[] = {
+        /* malloc_1 can only allocate */
+        {"malloc_1", malloc_1::smalloc, nullptr, nullptr, nullptr, nullptr, nullptr,
+                nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+                nullptr, nullptr},
+        /* malloc_2 has no smemalign */
+        {"malloc_2", malloc_2::smalloc, malloc_2::scalloc, malloc_2::sfree, malloc_2::srealloc,
+                malloc_2::smalloc_usable_size, nullptr, malloc_2::_num_free_blocks, malloc_2::_num_free_bytes,
+                malloc_2::_num_allocated_blocks, malloc_2::_num_allocated_bytes, malloc_2::_size_meta_data,
+                malloc_2::_num_meta_data_bytes, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+        {"malloc_3", ENGINE_API(malloc_3), malloc_3::smallopt, malloc_3::sreserve, malloc_3::sprefill,
+                malloc_3::_num_sbrk_calls, malloc_3::_num_sbrk_calls_saved, malloc_3::sheap_stats,
+                malloc_3::sheap_snapshot, malloc_3::sheap_iterate},
+        {"malloc_4", ENGINE_API(malloc_4), malloc_4::smallopt, malloc_4::sreserve, malloc_4::sprefill,
+                malloc_4::_num_sbrk_calls, malloc_4::_num_sbrk_calls_saved, malloc_4::sheap_stats,
+                malloc_4::sheap_snapshot, malloc_4::sheap_iterate},
+        {"buddy", ENGINE_API(malloc_buddy), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+        {"tlsf", ENGINE_API(malloc_tlsf), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+#define NUM_ENGINES ((int)(sizeof(engines) / sizeof(engines[0])))
+
+const SmallocEngine* current_engine = nullptr;
+/* Serializes the engine calls of every front end (see sengine_lock()) */
+pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Once something was allocated the engine can't change (its blocks would be freed by another engine) */
+bool engine_locked = false;
+
+/**
+ * Called by every allocation: the first one locks the engine and starts the trace $SMALLOC_TRACE asks for
+ * and the profiler $SMALLOC_PROFILE asks for
+ */
+void lockEngine() {
+    if(not engine_locked) {
+        engine_locked = true;
+        const char* trace_path = getenv("SMALLOC_TRACE");
+        if(trace_path) {
+            strace_start(trace_path);
+        }
+        sprofileStartFromEnv();
+    }
+}
+
+const SmallocEngine* findEngine(const char* name) {
+    if(name == nullptr) {
+        return nullptr;
+    }
+    for (int i = 0; i < NUM_ENGINES; ++i) {
+        if(strcmp(engines[i].name, name) == 0) {
+            return &engines[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * The engine calls go to - chosen by sengine_select(), else by $SMALLOC_ENGINE, else DEFAULT_ENGINE
+ */
+const SmallocEngine* engine() {
+    if(current_engine == nullptr) {
+        current_engine = findEngine(getenv("SMALLOC_ENGINE"));
+        if(current_engine == nullptr) {
+            current_engine = findEngine(DEFAULT_ENGINE);
+        }
+    }
+    return current_engine;
+}
+
+/**
+ * Pick the engine by name
+ * @param name malloc_1 / malloc_2 / malloc_3 / malloc_4 / buddy / tlsf
+ * @return 1 on success, 0 if there is no such engine or something was already allocated
+ */
+int sengine_select(const char* name) {
+    const SmallocEngine* selected = findEngine(name);
+    if(selected == nullptr or (engine_locked and selected != engine())) {
+        return 0;
+    }
+    current_engine = selected;
+    return 1;
+}
+
+const char* sengine_name() {
+    return engine()->name;
+}
+
+/**
+ * Take the engine lock - not recursive, so nothing called under it may take it again
+ */
+void sengine_lock() {
+    pthread_mutex_lock(&engine_lock);
+}
+
+void sengine_unlock() {
+    pthread_mutex_unlock(&engine_lock);
+}
+
+void* smalloc(size_t size) {
+    lockEngine();
+    void* p = engine()->smalloc(size);
+    straceCall(STRACE_MALLOC, size, p);
+    sprofileAllocCall(size, p);
+    return p;
+}
+
+void* scalloc(size_t num, size_t size) {
+    lockEngine();
+    if(engine()->scalloc == nullptr) {
+        return nullptr;
+    }
+    void* p = engine()->scalloc(num, size);
+    straceCall(STRACE_CALLOC, num * size, p);
+    sprofileAllocCall(num * size, p);
+    return p;
+}
+
+void sfree(void* p) {
+    if(engine()->sfree) {
+        sprofileFreeCall(p);
+        engine()->sfree(p);
+        straceCall(STRACE_FREE, 0, p);
+    }
+}
+
+/**
+ * sfree() for callers that know the size they asked for (sized operator delete).
+ * Every engine keeps the header right before the payload, so there is no lookup to skip - the size is only checked
+ * @param p
+ * @param size
+ */
+void sfree_sized(void* p, size_t size) {
+    assert(p == nullptr or engine()->smalloc_usable_size == nullptr or size <= engine()->smalloc_usable_size(p));
+    (void)(size);
+    sfree(p);
+}
+
+void* srealloc(void* oldp, size_t new_size) {
+    lockEngine();
+    if(engine()->srealloc == nullptr) {
+        return nullptr;
+    }
+    void* p = engine()->srealloc(oldp, new_size);
+    straceCall(STRACE_REALLOC, new_size, p, oldp);
+    if(p) {
+        sprofileFreeCall(oldp);
+        sprofileAllocCall(new_size, p);
+    }
+    return p;
+}
+
+void* smemalign(size_t alignment, size_t size) {
+    lockEngine();
+    if(engine()->smemalign == nullptr) {
+        return nullptr;
+    }
+    void* p = engine()->smemalign(alignment, size);
+    straceCall(STRACE_MEMALIGN, size, p, nullptr, alignment);
+    sprofileAllocCall(size, p);
+    return p;
+}
+
+size_t smalloc_usable_size(void* p) {
+    if(engine()->smalloc_usable_size == nullptr) {
+        return 0;
+    }
+    return engine()->smalloc_usable_size(p);
+}
+
+/* Statistics an engine doesn't keep read as 0 */
+#define ENGINE_STAT(stat) (engine()->stat ? engine()->stat() : 0)
+
+size_t _num_free_blocks() {
+    return ENGINE_STAT(num_free_blocks);
+}
+
+size_t _num_free_bytes() {
+    return ENGINE_STAT(num_free_bytes);
+}
+
+size_t _num_allocated_blocks() {
+    return ENGINE_STAT(num_allocated_blocks);
+}
+
+size_t _num_allocated_bytes() {
+    return ENGINE_STAT(num_allocated_bytes);
+}
+
+size_t _size_meta_data() {
+    return ENGINE_STAT(size_meta_data);
+}
+
+size_t _num_meta_data_bytes() {
+    return ENGINE_STAT(num_meta_data_bytes);
+}
+
+int smallopt(int param, size_t value) {
+    /* The heap backend is the engine's heap - switching engines after choosing it would leave it behind */
+    if(param == M_HEAP_BACKEND) {
+        lockEngine();
+    }
+    return engine()->smallopt ? engine()->smallopt(param, value) : 0;
+}
+
+/* Reserved and prefilled memory belongs to the engine's heap, so both lock the engine like an allocation */
+int sreserve(size_t bytes, int flags) {
+    lockEngine();
+    return engine()->sreserve ? engine()->sreserve(bytes, flags) : 0;
+}
+
+int sprefill(size_t size, size_t count, int flags) {
+    lockEngine();
+    return engine()->sprefill ? engine()->sprefill(size, count, flags) : 0;
+}
+
+size_t _num_sbrk_calls() {
+    return ENGINE_STAT(num_sbrk_calls);
+}
+
+size_t _num_sbrk_calls_saved() {
+    return ENGINE_STAT(num_sbrk_calls_saved);
+}
+
+/* The heap views are taken under the engine lock, so threads of the front ends can't relink blocks meanwhile */
+int sheap_stats(SHeapStats* stats) {
+    if(engine()->sheap_stats == nullptr) {
+        return 0;
+    }
+    sengine_lock();
+    int result = engine()->sheap_stats(stats);
+    sengine_unlock();
+    return result;
+}
+
+int sheap_snapshot(int fd) {
+    if(engine()->sheap_snapshot == nullptr) {
+        return 0;
+    }
+    sengine_lock();
+    int result = engine()->sheap_snapshot(fd);
+    sengine_unlock();
+    return result;
+}
+
+int sheap_iterate(SHeapVisitor visitor, void* ctx) {
+    if(engine()->sheap_iterate == nullptr) {
+        return 0;
+    }
+    sengine_lock();
+    int result = engine()->sheap_iterate(visitor, ctx);
+    sengine_unlock();
+    return result;
+}
@@ -0,0 +1,147 @@
+//
+// Global operator new / delete on top of the dispatch library - link smalloc_new into a C++ program
+// and all its new / delete expressions allocate from the selected engine. The engines are single threaded, so every
+// call is made under the engine lock (sengine_lock()).
+//
+
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include "Mymalloc.h"
+
+/* Every size is rounded up to it, so the heap engines hand out payloads aligned as operator new promises */
+#define NEW_ALIGNMENT ((size_t)(__STDCPP_DEFAULT_NEW_ALIGNMENT__))
+
+static void freeBlock(void* p) {
+    sengine_lock();
+    sfree(p);
+    sengine_unlock();
+}
+
+static void freeSizedBlock(void* p, size_t size) {
+    sengine_lock();
+    sfree_sized(p, size);
+    sengine_unlock();
+}
+
+/**
+ * Allocate like operator new: retry through the new handler, throw std::bad_alloc when out of memory
+ * @param size
+ * @param alignment 0 for the default alignment
+ */
+static void* newBlock(size_t size, size_t alignment) {
+    /* new of 0 bytes still gets a unique pointer */
+    if(size == 0) {
+        size = 1;
+    }
+    if(size > SIZE_MAX - NEW_ALIGNMENT) {
+        throw std::bad_alloc();
+    }
+    size = (size + NEW_ALIGNMENT - 1) & ~(NEW_ALIGNMENT - 1);
+    while(true) {
+        sengine_lock();
+        void* p = alignment > NEW_ALIGNMENT ? smemalign(alignment, size) : smalloc(size);
+        sengine_unlock();
+        if(p != nullptr) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if(handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+static void* newBlockNothrow(size_t size, size_t alignment) noexcept {
+    try {
+        return newBlock(size, alignment);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new(size_t size) {
+    return newBlock(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return newBlock(size, 0);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return newBlockNothrow(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return newBlockNothrow(size, 0);
+}
+
+void operator delete(void* p) noexcept {
+    freeBlock(p);
+}
+
+void operator delete[](void* p) noexcept {
+    freeBlock(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    freeBlock(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    freeBlock(p);
+}
+
+/* Sized delete - the compiler passes the size given to new */
+void operator delete(void* p, size_t size) noexcept {
+    freeSizedBlock(p, size);
+}
+
+void operator delete[](void* p, size_t size) noexcept {
+    freeSizedBlock(p, size);
+}
+
+#if __cpp_aligned_new
+/* Over-aligned types (alignof > __STDCPP_DEFAULT_NEW_ALIGNMENT__) get a real aligned block from smemalign() */
+void* operator new(size_t size, std::align_val_t alignment) {
+    return newBlock(size, (size_t)(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return newBlock(size, (size_t)(alignment));
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return newBlockNothrow(size, (size_t)(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return newBlockNothrow(size, (size_t)(alignment));
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    freeBlock(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    freeBlock(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    freeBlock(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    freeBlock(p);
+}
+
+void operator delete(void* p, size_t size, std::align_val_t) noexcept {
+    freeSizedBlock(p, size);
+}
+
+void operator delete[](void* p, size_t size, std::align_val_t) noexcept {
+    freeSizedBlock(p, size);
+}
+#endif
@@ -0,0 +1,351 @@
+//
+// The libc allocation API on top of the dispatch library, linked into libsmalloc.so so unmodified binaries
+// can run on the engines:
+//     LD_PRELOAD=libsmalloc.so SMALLOC_ENGINE=malloc_3 ./program
+// Nothing is forwarded to libc's malloc, so there is no dlsym(RTLD_NEXT) lookup - the bootstrap buffer serves
+// whatever libc allocates while the shim itself is set up (pthread_atfork registration).
+// The engines refuse requests above 1e8 bytes (the course's cap), the shim maps those itself.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "Mymalloc.h"
+
+/* Every size is rounded up to it so the heap engines hand out aligned payloads (MALLOC_ALIGNMENT in BlockMetaDataList.h) */
+#define PRELOAD_ALIGNMENT ((size_t)16)
+#define BOOTSTRAP_SIZE ((size_t)(64 * 1024))
+/* Biggest request the engines serve, bigger ones are big blocks */
+#define ENGINE_MAX_SIZE ((size_t)(1e8))
+
+#define SHIM_API extern "C" __attribute__((visibility("default")))
+
+pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+bool initialized = false;
+bool initializing = false;
+pthread_t init_thread;
+
+/* Bootstrap blocks are [size][padding][payload] bump allocated, freeing them does nothing */
+alignas(PRELOAD_ALIGNMENT) char bootstrap_buffer[BOOTSTRAP_SIZE];
+size_t bootstrap_top = 0;
+
+bool isBootstrap(void* p) {
+    return (char*)(p) >= bootstrap_buffer and (char*)(p) < bootstrap_buffer + BOOTSTRAP_SIZE;
+}
+
+void* bootstrapAlloc(size_t size) {
+    size = (size + PRELOAD_ALIGNMENT - 1) & ~(PRELOAD_ALIGNMENT - 1);
+    if(size > BOOTSTRAP_SIZE - bootstrap_top - PRELOAD_ALIGNMENT) {
+        return nullptr;
+    }
+    char* block = bootstrap_buffer + bootstrap_top;
+    *(size_t*)(block) = size;
+    bootstrap_top += PRELOAD_ALIGNMENT + size;
+    return block + PRELOAD_ALIGNMENT;
+}
+
+size_t bootstrapSize(void* p) {
+    return *(size_t*)((char*)(p) - PRELOAD_ALIGNMENT);
+}
+
+/**
+ * This is a big block - a request above ENGINE_MAX_SIZE mapped by the shim. The header is at the start of the mapping,
+ * the payload follows it (aligned). The big blocks are few (each is over 100MB), so free() finds them in a list.
+ */
+struct BigBlock {
+    BigBlock* next;
+    BigBlock* prev;
+    /* Bytes mapped */
+    size_t length;
+    /* Bytes from the payload to the end of the mapping */
+    size_t size;
+    void* payload;
+};
+
+/* The big blocks, under the engine lock */
+BigBlock* big_blocks = nullptr;
+
+/**
+ * Map a big block
+ * @return its payload or nullptr if mmap fails
+ */
+void* bigAlloc(size_t alignment, size_t size) {
+    size_t page_size = (size_t)(getpagesize());
+    if(alignment < PRELOAD_ALIGNMENT) {
+        alignment = PRELOAD_ALIGNMENT;
+    }
+    if(size > SIZE_MAX - sizeof(BigBlock) - alignment - page_size) {
+        return nullptr;
+    }
+    size_t length = (sizeof(BigBlock) + alignment + size + page_size - 1) & ~(page_size - 1);
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    BigBlock* block = (BigBlock*)(mapping);
+    char* payload = (char*)(((uintptr_t)(block + 1) + alignment - 1) & ~((uintptr_t)(alignment) - 1));
+    block->length = length;
+    block->size = (char*)(mapping) + length - payload;
+    block->payload = payload;
+    sengine_lock();
+    block->prev = nullptr;
+    block->next = big_blocks;
+    if(big_blocks) {
+        big_blocks->prev = block;
+    }
+    big_blocks = block;
+    sengine_unlock();
+    return payload;
+}
+
+/**
+ * The big block of p, called with the engine lock held
+ * @return nullptr if p came from the engine
+ */
+BigBlock* findBigBlock(void* p) {
+    for (BigBlock* block = big_blocks; block; block = block->next) {
+        if(block->payload == p) {
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Unlink and unmap a big block, called with the engine lock held
+ */
+void bigFree(BigBlock* block) {
+    if(block->prev) {
+        block->prev->next = block->next;
+    }
+    else {
+        big_blocks = block->next;
+    }
+    if(block->next) {
+        block->next->prev = block->prev;
+    }
+    munmap(block, block->length);
+}
+
+/* fork() in a multithreaded program: hold the engine lock across it so the child's heap isn't caught mid-update */
+void forkPrepare() {
+    sengine_lock();
+}
+
+void forkParent() {
+    sengine_unlock();
+}
+
+/* The child's only thread forked holding the lock (a plain mutex, so it can release it) */
+void forkChild() {
+    sengine_unlock();
+}
+
+/**
+ * Set up the shim on the first call, allocations made meanwhile by the initializing thread come from the bootstrap buffer
+ * @return true if the caller is the initializing thread
+ */
+bool inBootstrap() {
+    if(__atomic_load_n(&initialized, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    if(initializing and pthread_equal(init_thread, pthread_self())) {
+        return true;
+    }
+    pthread_mutex_lock(&init_lock);
+    if(not initialized) {
+        init_thread = pthread_self();
+        initializing = true;
+        /* Resolve the engine ($SMALLOC_ENGINE) now */
+        sengine_name();
+        pthread_atfork(forkPrepare, forkParent, forkChild);
+        initializing = false;
+        __atomic_store_n(&initialized, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&init_lock);
+    return false;
+}
+
+/**
+ * Round a request up to PRELOAD_ALIGNMENT, malloc(0) still gets a unique pointer
+ * @return 0 on overflow
+ */
+size_t preloadSize(size_t size) {
+    if(size == 0) {
+        size = 1;
+    }
+    if(size > SIZE_MAX - PRELOAD_ALIGNMENT) {
+        return 0;
+    }
+    return (size + PRELOAD_ALIGNMENT - 1) & ~(PRELOAD_ALIGNMENT - 1);
+}
+
+void* preloadAlloc(size_t alignment, size_t size) {
+    if(inBootstrap()) {
+        return alignment <= PRELOAD_ALIGNMENT ? bootstrapAlloc(size) : nullptr;
+    }
+    size = preloadSize(size);
+    void* p = nullptr;
+    if(size > ENGINE_MAX_SIZE) {
+        p = bigAlloc(alignment, size);
+    }
+    else if(size != 0) {
+        sengine_lock();
+        p = alignment <= PRELOAD_ALIGNMENT ? smalloc(size) : smemalign(alignment, size);
+        sengine_unlock();
+    }
+    if(p == nullptr) {
+        errno = ENOMEM;
+    }
+    return p;
+}
+
+bool isPowerOfTwo(size_t alignment) {
+    return alignment != 0 and (alignment & (alignment - 1)) == 0;
+}
+
+SHIM_API void* malloc(size_t size) noexcept {
+    return preloadAlloc(PRELOAD_ALIGNMENT, size);
+}
+
+SHIM_API void free(void* p) noexcept {
+    if(p == nullptr or isBootstrap(p)) {
+        return;
+    }
+    sengine_lock();
+    BigBlock* block = findBigBlock(p);
+    if(block) {
+        bigFree(block);
+    }
+    else {
+        sfree(p);
+    }
+    sengine_unlock();
+}
+
+SHIM_API void* calloc(size_t num, size_t size) noexcept {
+    size_t total;
+    if(__builtin_mul_overflow(num, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    if(inBootstrap()) {
+        /* The bootstrap buffer is never reused so it is still zeroed */
+        return bootstrapAlloc(total);
+    }
+    total = preloadSize(total);
+    void* p = nullptr;
+    if(total > ENGINE_MAX_SIZE) {
+        /* Fresh anonymous pages are zeroed */
+        p = bigAlloc(PRELOAD_ALIGNMENT, total);
+    }
+    else if(total != 0) {
+        sengine_lock();
+        p = scalloc(1, total);
+        sengine_unlock();
+    }
+    if(p == nullptr) {
+        errno = ENOMEM;
+    }
+    return p;
+}
+
+SHIM_API void* realloc(void* oldp, size_t new_size) noexcept {
+    if(oldp == nullptr) {
+        return malloc(new_size);
+    }
+    if(new_size == 0) {
+        free(oldp);
+        return nullptr;
+    }
+    if(isBootstrap(oldp)) {
+        /* Move out of the bootstrap buffer */
+        void* newp = malloc(new_size);
+        if(newp != nullptr) {
+            memcpy(newp, oldp, bootstrapSize(oldp) < new_size ? bootstrapSize(oldp) : new_size);
+        }
+        return newp;
+    }
+    size_t size = preloadSize(new_size);
+    if(size == 0) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    sengine_lock();
+    BigBlock* block = findBigBlock(oldp);
+    size_t old_size = block ? block->size : 0;
+    void* newp = nullptr;
+    if(block == nullptr and size <= ENGINE_MAX_SIZE) {
+        newp = srealloc(oldp, size);
+    }
+    else if(block == nullptr) {
+        old_size = smalloc_usable_size(oldp);
+    }
+    sengine_unlock();
+    if(block and size <= old_size and size > ENGINE_MAX_SIZE) {
+        /* Still a big block and it fits */
+        return oldp;
+    }
+    if(newp == nullptr and (block or size > ENGINE_MAX_SIZE)) {
+        /* In or out of a big block - move the payload */
+        newp = malloc(new_size);
+        if(newp != nullptr) {
+            memcpy(newp, oldp, old_size < new_size ? old_size : new_size);
+            free(oldp);
+        }
+    }
+    if(newp == nullptr) {
+        errno = ENOMEM;
+    }
+    return newp;
+}
+
+SHIM_API int posix_memalign(void** memptr, size_t alignment, size_t size) noexcept {
+    if(not isPowerOfTwo(alignment) or alignment % sizeof(void*) != 0) {
+        return EINVAL;
+    }
+    void* p = preloadAlloc(alignment, size);
+    if(p == nullptr) {
+        return ENOMEM;
+    }
+    *memptr = p;
+    return 0;
+}
+
+SHIM_API void* aligned_alloc(size_t alignment, size_t size) noexcept {
+    if(not isPowerOfTwo(alignment)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return preloadAlloc(alignment, size);
+}
+
+SHIM_API void* memalign(size_t alignment, size_t size) noexcept {
+    return aligned_alloc(alignment, size);
+}
+
+SHIM_API void* valloc(size_t size) noexcept {
+    return preloadAlloc((size_t)(getpagesize()), size);
+}
+
+SHIM_API void* pvalloc(size_t size) noexcept {
+    size_t page_size = (size_t)(getpagesize());
+    return preloadAlloc(page_size, (size + page_size - 1) & ~(page_size - 1));
+}
+
+SHIM_API size_t malloc_usable_size(void* p) noexcept {
+    if(p == nullptr) {
+        return 0;
+    }
+    if(isBootstrap(p)) {
+        return bootstrapSize(p);
+    }
+    sengine_lock();
+    BigBlock* block = findBigBlock(p);
+    size_t size = block ? block->size : smalloc_usable_size(p);
+    sengine_unlock();
+    return size;
+}
@@ -0,0 +1,374 @@
+//
+// Sampling heap profiler of the dispatch library. Sampled call stacks are unwound with the unwinder of the C++ runtime
+// (_Unwind_Backtrace, CFI based - no frame pointers needed) and charged to a site in a lock-free open addressing table,
+// the sampled objects that are still live sit in a second one (keyed by address) so their frees can be charged back.
+// Both tables are mmapped, so profiling never touches the heap it profiles.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unwind.h>
+#include "SProfile.h"
+#include "Mymalloc.h"
+
+/* Table sizes (powers of two) and how far an insertion probes before the sample is dropped */
+#define SPROFILE_SITES 8192
+#define SPROFILE_LIVE_SLOTS 65536
+#define SPROFILE_MAX_PROBES 64
+/* A live slot whose object was freed - lookups go on past it, insertions may take it */
+#define LIVE_TOMBSTONE ((uintptr_t)(1))
+
+/**
+ * This is a call site - a sampled call stack and what was sampled there
+ */
+struct SProfileSite {
+    /* 0 - empty slot */
+    std::atomic<uint64_t> hash;
+    /* 0 until frames are written */
+    std::atomic<int> depth;
+    void* frames[SPROFILE_MAX_DEPTH];
+    std::atomic<uint64_t> alloc_count;
+    std::atomic<uint64_t> alloc_bytes;
+    std::atomic<uint64_t> live_count;
+    std::atomic<uint64_t> live_bytes;
+};
+
+/**
+ * This is a sampled object that wasn't freed yet
+ */
+struct SProfileLive {
+    std::atomic<uintptr_t> addr;
+    SProfileSite* site;
+    size_t size;
+};
+
+std::atomic<bool> sprofile_on(false);
+static SProfileSite* sites = nullptr;
+static SProfileLive* live = nullptr;
+static size_t sample_bytes = SPROFILE_DEFAULT_SAMPLE_BYTES;
+static std::atomic<size_t> num_live(0);
+/* Process that started profiling - a fork()ed child doesn't write the parent's profile at exit */
+static pid_t profile_pid = 0;
+static thread_local int64_t bytes_left = 0;
+static thread_local bool has_interval = false;
+static thread_local uint64_t random_state = 0;
+
+static uint64_t nowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Bytes to the next sample: exponentially distributed with mean sample_bytes, so every allocated byte has the same
+ * chance to be sampled whatever the sizes around it
+ */
+static int64_t nextInterval() {
+    if(random_state == 0) {
+        random_state = ((uint64_t)(uintptr_t)(&random_state) ^ nowNs()) | 1;
+    }
+    /* xorshift64 */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    /* Uniform in (0, 1) */
+    double uniform = ((double)(random_state >> 11) + 0.5) / (double)((uint64_t)(1) << 53);
+    return (int64_t)(-std::log(uniform) * (double)(sample_bytes)) + 1;
+}
+
+struct Unwind {
+    void** frames;
+    int depth;
+    int skip;
+};
+
+static _Unwind_Reason_Code unwindFrame(_Unwind_Context* context, void* arg) {
+    Unwind* unwind = (Unwind*)(arg);
+    if(unwind->skip > 0) {
+        unwind->skip--;
+        return _URC_NO_REASON;
+    }
+    uintptr_t ip = _Unwind_GetIP(context);
+    if(ip == 0 or unwind->depth == SPROFILE_MAX_DEPTH) {
+        return _URC_END_OF_STACK;
+    }
+    unwind->frames[unwind->depth++] = (void*)(ip);
+    return _URC_NO_REASON;
+}
+
+/**
+ * Call stack of the allocation being sampled, from the s* call's caller outwards
+ * (the allocator's own frames are trimmed by pprof)
+ * @return number of frames
+ */
+__attribute__((noinline)) static int captureStack(void** frames) {
+    /* captureStack and sprofileAlloc */
+    Unwind unwind = {frames, 0, 2};
+    _Unwind_Backtrace(unwindFrame, &unwind);
+    return unwind.depth;
+}
+
+static uint64_t hashFrames(void* const* frames, int depth) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < depth; ++i) {
+        hash = (hash ^ (uint64_t)(uintptr_t)(frames[i])) * 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+/**
+ * The site of a call stack, claimed on its first sample
+ * @return nullptr if the table is full around the stack's slot
+ */
+static SProfileSite* findSite(void* const* frames, int depth) {
+    uint64_t hash = hashFrames(frames, depth);
+    for (size_t i = 0; i < SPROFILE_MAX_PROBES; ++i) {
+        SProfileSite* site = &sites[(hash + i) & (SPROFILE_SITES - 1)];
+        uint64_t current = site->hash.load(std::memory_order_acquire);
+        if(current == 0) {
+            if(site->hash.compare_exchange_strong(current, hash)) {
+                memcpy(site->frames, frames, depth * sizeof(void*));
+                site->depth.store(depth, std::memory_order_release);
+                return site;
+            }
+            /* Another thread claimed it, current is its hash now */
+        }
+        if(current != hash) {
+            continue;
+        }
+        int site_depth;
+        /* Claimed but not written yet */
+        while((site_depth = site->depth.load(std::memory_order_acquire)) == 0) {
+        }
+        if(site_depth == depth and memcmp(site->frames, frames, depth * sizeof(void*)) == 0) {
+            return site;
+        }
+    }
+    return nullptr;
+}
+
+static size_t hashAddress(uintptr_t addr) {
+    return (size_t)((addr >> 4) * 0x9E3779B97F4A7C15ULL >> 16);
+}
+
+static bool insertLive(void* p, SProfileSite* site, size_t size) {
+    uintptr_t addr = (uintptr_t)(p);
+    size_t start = hashAddress(addr);
+    for (size_t i = 0; i < SPROFILE_MAX_PROBES; ++i) {
+        SProfileLive& slot = live[(start + i) & (SPROFILE_LIVE_SLOTS - 1)];
+        uintptr_t current = slot.addr.load(std::memory_order_relaxed);
+        if((current == 0 or current == LIVE_TOMBSTONE) and slot.addr.compare_exchange_strong(current, addr)) {
+            /* Only a free of p reads them, and p isn't handed out yet */
+            slot.site = site;
+            slot.size = size;
+            num_live.fetch_add(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Sample the allocation if the thread's byte countdown ran out
+ * @param size bytes asked for
+ * @param p the allocation
+ */
+__attribute__((noinline)) void sprofileAlloc(size_t size, void* p) {
+    if(not has_interval) {
+        has_interval = true;
+        bytes_left = nextInterval();
+    }
+    bytes_left -= (int64_t)(size);
+    if(bytes_left > 0) {
+        return;
+    }
+    bytes_left = nextInterval();
+    void* frames[SPROFILE_MAX_DEPTH];
+    int depth = captureStack(frames);
+    /* A sample is dropped if its site doesn't fit in the table */
+    SProfileSite* site = depth > 0 ? findSite(frames, depth) : nullptr;
+    if(site == nullptr) {
+        return;
+    }
+    site->alloc_count.fetch_add(1);
+    site->alloc_bytes.fetch_add(size);
+    if(insertLive(p, site, size)) {
+        site->live_count.fetch_add(1);
+        site->live_bytes.fetch_add(size);
+    }
+}
+
+/**
+ * Charge a sampled object's free back to its site (anything else is ignored)
+ * @param p
+ */
+void sprofileFree(void* p) {
+    if(num_live.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    uintptr_t addr = (uintptr_t)(p);
+    size_t start = hashAddress(addr);
+    for (size_t i = 0; i < SPROFILE_MAX_PROBES; ++i) {
+        SProfileLive& slot = live[(start + i) & (SPROFILE_LIVE_SLOTS - 1)];
+        uintptr_t current = slot.addr.load(std::memory_order_acquire);
+        if(current == 0) {
+            return;
+        }
+        if(current != addr) {
+            continue;
+        }
+        slot.site->live_count.fetch_sub(1);
+        slot.site->live_bytes.fetch_sub(slot.size);
+        /* The end of a probe chain can go back to empty, so lookups stop early again
+         * (an insertion racing past it would lose its free - the s* calls are serialized anyway) */
+        bool chain_end = live[(start + i + 1) & (SPROFILE_LIVE_SLOTS - 1)].addr.load(std::memory_order_relaxed) == 0;
+        slot.addr.store(chain_end ? 0 : LIVE_TOMBSTONE, std::memory_order_release);
+        num_live.fetch_sub(1);
+        return;
+    }
+}
+
+static void* mapTable(size_t bytes) {
+    void* addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return addr == MAP_FAILED ? nullptr : addr;
+}
+
+/**
+ * Start sampling allocations (previous samples are dropped) until sprofile_stop().
+ * SMALLOC_PROFILE=<prefix> starts profiling at the first allocation and writes <prefix>.<pid>.heap at exit,
+ * SMALLOC_PROFILE_RATE=<bytes> sets its sample_bytes.
+ * @param bytes mean bytes between samples (0 - SPROFILE_DEFAULT_SAMPLE_BYTES)
+ * @return 1 on success, 0 if profiling already runs or the tables can't be mapped
+ */
+int sprofile_start(size_t bytes) {
+    if(sprofile_on.load()) {
+        return 0;
+    }
+    if(sites == nullptr) {
+        sites = (SProfileSite*)(mapTable(SPROFILE_SITES * sizeof(SProfileSite)));
+        live = (SProfileLive*)(mapTable(SPROFILE_LIVE_SLOTS * sizeof(SProfileLive)));
+        if(sites == nullptr or live == nullptr) {
+            sites = nullptr;
+            return 0;
+        }
+    }
+    else {
+        /* Back to zero pages */
+        madvise(sites, SPROFILE_SITES * sizeof(SProfileSite), MADV_DONTNEED);
+        madvise(live, SPROFILE_LIVE_SLOTS * sizeof(SProfileLive), MADV_DONTNEED);
+    }
+    sample_bytes = bytes ? bytes : SPROFILE_DEFAULT_SAMPLE_BYTES;
+    num_live.store(0);
+    profile_pid = getpid();
+    sprofile_on.store(true);
+    return 1;
+}
+
+/**
+ * Stop sampling - the samples stay (frees no longer count either) for sprofile_dump()
+ */
+void sprofile_stop() {
+    sprofile_on.store(false);
+}
+
+static bool writeAll(int fd, const char* data, size_t bytes) {
+    while(bytes > 0) {
+        ssize_t written = write(fd, data, bytes);
+        if(written <= 0) {
+            return false;
+        }
+        data += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+/**
+ * Write the profile in the gperftools heap profile format (heap_v2) - a totals line, a line per site with its live
+ * [and all-time] sampled objects and bytes and its stack, then the process' mappings for symbolizing.
+ * The counts are the raw samples, pprof scales them by the sampling rate in the header.
+ * @param fd
+ * @return 1 on success, 0 if nothing was profiled or writing fails
+ */
+int sprofile_dump(int fd) {
+    if(sites == nullptr) {
+        return 0;
+    }
+    uint64_t totals[4] = {};
+    for (size_t i = 0; i < SPROFILE_SITES; ++i) {
+        if(sites[i].depth.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+        totals[0] += sites[i].live_count.load();
+        totals[1] += sites[i].live_bytes.load();
+        totals[2] += sites[i].alloc_count.load();
+        totals[3] += sites[i].alloc_bytes.load();
+    }
+    char line[64 + SPROFILE_MAX_DEPTH * 20];
+    int length = snprintf(line, sizeof(line), "heap profile: %6llu: %8llu [%6llu: %8llu] @ heap_v2/%zu\n",
+                          (unsigned long long)(totals[0]), (unsigned long long)(totals[1]),
+                          (unsigned long long)(totals[2]), (unsigned long long)(totals[3]), sample_bytes);
+    if(not writeAll(fd, line, length)) {
+        return 0;
+    }
+    for (size_t i = 0; i < SPROFILE_SITES; ++i) {
+        SProfileSite& site = sites[i];
+        int depth = site.depth.load(std::memory_order_acquire);
+        if(depth == 0) {
+            continue;
+        }
+        length = snprintf(line, sizeof(line), "%6llu: %8llu [%6llu: %8llu] @",
+                          (unsigned long long)(site.live_count.load()), (unsigned long long)(site.live_bytes.load()),
+                          (unsigned long long)(site.alloc_count.load()), (unsigned long long)(site.alloc_bytes.load()));
+        for (int frame = 0; frame < depth; ++frame) {
+            length += snprintf(line + length, sizeof(line) - length, " %p", site.frames[frame]);
+        }
+        line[length++] = '\n';
+        if(not writeAll(fd, line, length)) {
+            return 0;
+        }
+    }
+    if(not writeAll(fd, "\nMAPPED_LIBRARIES:\n", strlen("\nMAPPED_LIBRARIES:\n"))) {
+        return 0;
+    }
+    int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if(maps < 0) {
+        return 1;
+    }
+    ssize_t bytes;
+    while((bytes = read(maps, line, sizeof(line))) > 0 and writeAll(fd, line, bytes)) {
+    }
+    close(maps);
+    return 1;
+}
+
+/* SMALLOC_PROFILE - called by the first allocation */
+void sprofileStartFromEnv() {
+    if(getenv("SMALLOC_PROFILE") == nullptr) {
+        return;
+    }
+    const char* rate = getenv("SMALLOC_PROFILE_RATE");
+    sprofile_start(rate ? strtoull(rate, nullptr, 10) : 0);
+}
+
+/* SMALLOC_PROFILE - the profile of the process that started it is written at exit */
+__attribute__((destructor)) static void dumpAtExit() {
+    const char* prefix = getenv("SMALLOC_PROFILE");
+    if(prefix == nullptr or sites == nullptr or getpid() != profile_pid) {
+        return;
+    }
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%d.heap", prefix, (int)(getpid()));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        return;
+    }
+    sprofile_stop();
+    sprofile_dump(fd);
+    close(fd);
+}
@@ -0,0 +1,493 @@
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <sys/mman.h>
+#include <algorithm>
+#include "SmallocEngine.h"
+
+SMALLOC_ENGINE_BEGIN
+
+/* Sizes are rounded to ALIGN, each first level class [2^f, 2^(f+1)) is split into SL_COUNT second level classes */
+#define ALIGN_LOG2 3
+#define ALIGN ((size_t)(1) << ALIGN_LOG2)
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + ALIGN_LOG2)
+#define SMALL_BLOCK_SIZE ((size_t)(1) << FL_SHIFT)
+#define FL_MAX_LOG2 26
+#define FL_COUNT (FL_MAX_LOG2 - FL_SHIFT + 2)
+/* Free blocks are never smaller than this, smaller remainders stay with the allocated block */
+#define MIN_BLOCK_SIZE ((size_t)(16))
+/* Memory is added in pools, bigger requests are mmapped like in malloc_3 */
+#define POOL_SIZE ((size_t)(4 * 1024 * 1024))
+#define MMAP_THRESHOLD ((size_t)(128e3))
+
+/**
+ * This is a metadata (boundary tag) at the start of every block.
+ * prev_phys links to the block right before it in memory so both neighbours are found in O(1).
+ */
+struct TlsfMetaData {
+    size_t size;
+    bool is_free;
+    bool is_mmapped;
+    TlsfMetaData* prev_phys;
+    TlsfMetaData* next_free;
+    TlsfMetaData* prev_free;
+    /* Keeps the header a multiple of 16 bytes so blocks of 16 byte multiples have 16 byte aligned payloads */
+    size_t padding;
+};
+
+/**
+ * This is a Two-Level Segregated Fit allocator: a first level bitmap of power of two classes and a second level
+ * bitmap per class point at segregated free lists, so finding a good fit, inserting and removing
+ * a free block are all a couple of bit scans - O(1) malloc and free with immediate coalescing.
+ */
+class TlsfAllocator {
+public:
+    unsigned int fl_bitmap = 0;
+    unsigned int sl_bitmap[FL_COUNT] = {};
+    TlsfMetaData* blocks[FL_COUNT][SL_COUNT] = {};
+    size_t num_free_bytes = 0;
+    size_t num_free_blocks = 0;
+    size_t total_bytes = 0;
+    size_t total_blocks = 0;
+    TlsfMetaData* allocateBlock(size_t size);
+    TlsfMetaData* allocateAlignedBlock(size_t size, size_t alignment);
+    TlsfMetaData* mmapAlignedBlock(size_t size, size_t alignment);
+    void freeBlock(TlsfMetaData* block);
+    TlsfMetaData* resizeBlock(TlsfMetaData* block, size_t size);
+    bool addPool();
+    void insertFree(TlsfMetaData* block);
+    void removeFree(TlsfMetaData* block);
+    TlsfMetaData* searchSuitableBlock(size_t size);
+    void splitBlock(TlsfMetaData* block, size_t size);
+    TlsfMetaData* mergeWithNext(TlsfMetaData* block);
+    static void mappingInsert(size_t size, int* fl, int* sl);
+    static TlsfMetaData* nextPhys(TlsfMetaData* block);
+    static size_t adjustSize(size_t size);
+};
+
+/**
+ * Index of the most significant bit
+ */
+static int fls(size_t size) {
+    return (int)(8 * sizeof(size_t)) - 1 - __builtin_clzl(size);
+}
+
+/**
+ * First and second level indexes of the free list a block of this size belongs to
+ */
+void TlsfAllocator::mappingInsert(size_t size, int *fl, int *sl) {
+    if(size < SMALL_BLOCK_SIZE) {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK_SIZE / SL_COUNT));
+        return;
+    }
+    int f = fls(size);
+    *sl = (int)(size >> (f - SL_LOG2)) ^ SL_COUNT;
+    *fl = f - (FL_SHIFT - 1);
+}
+
+TlsfMetaData *TlsfAllocator::nextPhys(TlsfMetaData *block) {
+    return (TlsfMetaData*)((char*)(block) + sizeof(TlsfMetaData) + block->size);
+}
+
+size_t TlsfAllocator::adjustSize(size_t size) {
+    size = (size + ALIGN - 1) & ~(ALIGN - 1);
+    return std::max(size, MIN_BLOCK_SIZE);
+}
+
+void TlsfAllocator::insertFree(TlsfMetaData *block) {
+    int fl, sl;
+    mappingInsert(block->size, &fl, &sl);
+    block->is_free = true;
+    block->prev_free = nullptr;
+    block->next_free = blocks[fl][sl];
+    if(blocks[fl][sl]) {
+        blocks[fl][sl]->prev_free = block;
+    }
+    blocks[fl][sl] = block;
+    fl_bitmap |= 1U << fl;
+    sl_bitmap[fl] |= 1U << sl;
+    num_free_blocks++;
+    num_free_bytes += block->size;
+}
+
+void TlsfAllocator::removeFree(TlsfMetaData *block) {
+    int fl, sl;
+    mappingInsert(block->size, &fl, &sl);
+    if(block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    }
+    else {
+        blocks[fl][sl] = block->next_free;
+        if(blocks[fl][sl] == nullptr) {
+            sl_bitmap[fl] &= ~(1U << sl);
+            if(sl_bitmap[fl] == 0) {
+                fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+    if(block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    block->is_free = false;
+    num_free_blocks--;
+    num_free_bytes -= block->size;
+}
+
+/**
+ * Good fit: round size up to the next second level class so any block of the found list fits
+ * @param size adjusted size
+ * @return a free block (still in its list) or nullptr
+ */
+TlsfMetaData *TlsfAllocator::searchSuitableBlock(size_t size) {
+    if(size >= SMALL_BLOCK_SIZE) {
+        size += ((size_t)(1) << (fls(size) - SL_LOG2)) - 1;
+    }
+    int fl, sl;
+    mappingInsert(size, &fl, &sl);
+    if(fl >= FL_COUNT) {
+        return nullptr;
+    }
+    unsigned int sl_map = sl_bitmap[fl] & (~0U << sl);
+    if(sl_map == 0) {
+        unsigned int fl_map = (fl + 1 < 32) ? fl_bitmap & (~0U << (fl + 1)) : 0;
+        if(fl_map == 0) {
+            return nullptr;
+        }
+        fl = __builtin_ctz(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+    return blocks[fl][sl];
+}
+
+/**
+ * Map a new pool: one free block followed by a zero sized used sentinel, so nextPhys never leaves the pool
+ * @return false if mmap fails
+ */
+bool TlsfAllocator::addPool() {
+    void* addr = mmap(NULL, POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    TlsfMetaData* block = (TlsfMetaData*)(addr);
+    block->size = POOL_SIZE - 2 * sizeof(TlsfMetaData);
+    block->is_mmapped = false;
+    block->prev_phys = nullptr;
+    TlsfMetaData* sentinel = nextPhys(block);
+    sentinel->size = 0;
+    sentinel->is_free = false;
+    sentinel->is_mmapped = false;
+    sentinel->prev_phys = block;
+    total_blocks++;
+    total_bytes += block->size;
+    insertFree(block);
+    return true;
+}
+
+/**
+ * Cut the tail of an allocated block into a new free block if it is big enough to stand on its own
+ * @param block
+ * @param size adjusted size the block keeps
+ */
+void TlsfAllocator::splitBlock(TlsfMetaData *block, size_t size) {
+    if(block->size < size + sizeof(TlsfMetaData) + MIN_BLOCK_SIZE) {
+        return;
+    }
+    TlsfMetaData* remainder = (TlsfMetaData*)((char*)(block) + sizeof(TlsfMetaData) + size);
+    remainder->size = block->size - size - sizeof(TlsfMetaData);
+    remainder->is_mmapped = false;
+    remainder->prev_phys = block;
+    block->size = size;
+    nextPhys(remainder)->prev_phys = remainder;
+    total_blocks++;
+    total_bytes -= sizeof(TlsfMetaData);
+    /* The remainder may touch a free block on its right */
+    remainder = mergeWithNext(remainder);
+    insertFree(remainder);
+}
+
+/**
+ * Absorb the next physical block if it is free
+ * @param block a block that is not in any free list
+ * @return block
+ */
+TlsfMetaData *TlsfAllocator::mergeWithNext(TlsfMetaData *block) {
+    TlsfMetaData* next = nextPhys(block);
+    if(next->is_free) {
+        removeFree(next);
+        block->size += sizeof(TlsfMetaData) + next->size;
+        nextPhys(block)->prev_phys = block;
+        total_blocks--;
+        total_bytes += sizeof(TlsfMetaData);
+    }
+    return block;
+}
+
+/**
+ * @param size
+ * @return nullptr if size is 0 / bigger than 1e8 or memory can't be added
+ */
+TlsfMetaData *TlsfAllocator::allocateBlock(size_t size) {
+    if(size == 0 or size > 1e8) {
+        return nullptr;
+    }
+    if(size > MMAP_THRESHOLD) {
+        void* addr = mmap(NULL, sizeof(TlsfMetaData) + size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED) {
+            return nullptr;
+        }
+        TlsfMetaData* block = (TlsfMetaData*)(addr);
+        block->size = size;
+        block->is_free = false;
+        block->is_mmapped = true;
+        total_blocks++;
+        total_bytes += size;
+        return block;
+    }
+    size = adjustSize(size);
+    TlsfMetaData* block = searchSuitableBlock(size);
+    if(block == nullptr) {
+        if(not addPool()) {
+            return nullptr;
+        }
+        block = searchSuitableBlock(size);
+    }
+    removeFree(block);
+    splitBlock(block, size);
+    return block;
+}
+
+/**
+ * Allocate a block whose payload address is a multiple of alignment - a big enough block is taken,
+ * its misaligned front is split off and freed and its tail is split as usual
+ * @param size
+ * @param alignment power of two
+ * @return nullptr on a bad alignment, if size is 0 / bigger than 1e8 or memory can't be added
+ */
+TlsfMetaData *TlsfAllocator::allocateAlignedBlock(size_t size, size_t alignment) {
+    if(alignment == 0 or (alignment & (alignment - 1)) != 0 or size == 0 or size > 1e8) {
+        return nullptr;
+    }
+    if(alignment <= ALIGN) {
+        return allocateBlock(size);
+    }
+    size = adjustSize(size);
+    /* The front has to be a block on its own */
+    size_t padded_size = size + alignment + sizeof(TlsfMetaData) + MIN_BLOCK_SIZE;
+    if(padded_size > MMAP_THRESHOLD) {
+        return mmapAlignedBlock(size, alignment);
+    }
+    TlsfMetaData* block = allocateBlock(padded_size);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    uintptr_t payload = (uintptr_t)(block) + sizeof(TlsfMetaData);
+    if(payload % alignment != 0) {
+        uintptr_t aligned = (payload + sizeof(TlsfMetaData) + MIN_BLOCK_SIZE + alignment - 1) & ~(alignment - 1);
+        TlsfMetaData* front = block;
+        block = (TlsfMetaData*)(aligned - sizeof(TlsfMetaData));
+        block->size = front->size - (aligned - payload);
+        block->is_free = false;
+        block->is_mmapped = false;
+        block->prev_phys = front;
+        nextPhys(block)->prev_phys = block;
+        front->size = aligned - payload - sizeof(TlsfMetaData);
+        total_blocks++;
+        total_bytes -= sizeof(TlsfMetaData);
+        freeBlock(front);
+    }
+    splitBlock(block, size);
+    return block;
+}
+
+/**
+ * mmap a block whose payload address is a multiple of alignment, the pages around it are unmapped right away
+ * (so the header may not start its mapping - freeBlock unmaps from the header's page)
+ * @return nullptr if mmap fails
+ */
+TlsfMetaData *TlsfAllocator::mmapAlignedBlock(size_t size, size_t alignment) {
+    size_t length = sizeof(TlsfMetaData) + size + alignment;
+    void* addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(addr == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t page_mask = (uintptr_t)(getpagesize()) - 1;
+    uintptr_t start = (uintptr_t)(addr);
+    uintptr_t payload = (start + sizeof(TlsfMetaData) + alignment - 1) & ~(alignment - 1);
+    uintptr_t first_page = (payload - sizeof(TlsfMetaData)) & ~page_mask;
+    uintptr_t end = (payload + size + page_mask) & ~page_mask;
+    uintptr_t map_end = (start + length + page_mask) & ~page_mask;
+    if(first_page > start) {
+        munmap(addr, first_page - start);
+    }
+    if(map_end > end) {
+        munmap((void*)(end), map_end - end);
+    }
+    TlsfMetaData* block = (TlsfMetaData*)(payload - sizeof(TlsfMetaData));
+    block->size = size;
+    block->is_free = false;
+    block->is_mmapped = true;
+    total_blocks++;
+    total_bytes += size;
+    return block;
+}
+
+/**
+ * Free a block and coalesce it right away with its free physical neighbours
+ * @param block
+ */
+void TlsfAllocator::freeBlock(TlsfMetaData *block) {
+    if(block->is_free) {
+        return;
+    }
+    if(block->is_mmapped) {
+        total_blocks--;
+        total_bytes -= block->size;
+        /* An aligned block's header may sit further into its first page */
+        uintptr_t first_page = (uintptr_t)(block) & ~((uintptr_t)(getpagesize()) - 1);
+        munmap((void*)(first_page), (uintptr_t)(block) - first_page + sizeof(TlsfMetaData) + block->size);
+        return;
+    }
+    block = mergeWithNext(block);
+    TlsfMetaData* prev = block->prev_phys;
+    if(prev and prev->is_free) {
+        removeFree(prev);
+        prev->size += sizeof(TlsfMetaData) + block->size;
+        nextPhys(prev)->prev_phys = prev;
+        total_blocks--;
+        total_bytes += sizeof(TlsfMetaData);
+        block = prev;
+    }
+    insertFree(block);
+}
+
+/**
+ * Resize in place - shrink by splitting or grow into a free next block
+ * @param block
+ * @param size
+ * @return block, or nullptr if it can't be resized in place
+ */
+TlsfMetaData *TlsfAllocator::resizeBlock(TlsfMetaData *block, size_t size) {
+    if(block->is_mmapped or size > MMAP_THRESHOLD) {
+        return nullptr;
+    }
+    size = adjustSize(size);
+    if(block->size < size) {
+        TlsfMetaData* next = nextPhys(block);
+        if(not next->is_free or block->size + sizeof(TlsfMetaData) + next->size < size) {
+            return nullptr;
+        }
+        mergeWithNext(block);
+    }
+    splitBlock(block, size);
+    return block;
+}
+
+TlsfAllocator tlsf_allocator;
+
+void* smalloc(size_t size) {
+    TlsfMetaData* block = tlsf_allocator.allocateBlock(size);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    return (void*)((char*)(block) + sizeof(TlsfMetaData));
+}
+
+void* scalloc(size_t num, size_t size) {
+    if(size != 0 and num > (size_t)(1e8) / size) {
+        return nullptr;
+    }
+    void* block = smalloc(num * size);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    /* Making a zeroes block */
+    memset(block, 0, num * size);
+    return block;
+}
+
+void sfree(void* p) {
+    if(p == nullptr) {
+        return;
+    }
+    tlsf_allocator.freeBlock((TlsfMetaData*)((char*)(p) - sizeof(TlsfMetaData)));
+}
+
+void* srealloc(void* oldp, size_t new_size) {
+    if(oldp == nullptr) {
+        return smalloc(new_size);
+    }
+    if(new_size == 0 or new_size > 1e8) {
+        return nullptr;
+    }
+    TlsfMetaData* block = (TlsfMetaData*)((char*)(oldp) - sizeof(TlsfMetaData));
+    /* A. Resize in place */
+    if(tlsf_allocator.resizeBlock(block, new_size)) {
+        return oldp;
+    }
+    /* B. Move to a new block */
+    void* newp = smalloc(new_size);
+    if(newp == nullptr) {
+        return nullptr;
+    }
+    memcpy(newp, oldp, std::min(block->size, new_size));
+    sfree(oldp);
+    return newp;
+}
+
+/**
+ * Allocate size bytes at an address that is a multiple of alignment (like memalign)
+ * @param alignment power of two
+ * @param size
+ * @return nullptr on a bad alignment / size or if there is no memory
+ */
+void* smemalign(size_t alignment, size_t size) {
+    TlsfMetaData* block = tlsf_allocator.allocateAlignedBlock(size, alignment);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    return (void*)((char*)(block) + sizeof(TlsfMetaData));
+}
+
+/**
+ * Usable bytes of an allocated block (like malloc_usable_size), may be more than was asked for
+ * @param p
+ * @return 0 for nullptr
+ */
+size_t smalloc_usable_size(void* p) {
+    if(p == nullptr) {
+        return 0;
+    }
+    return ((TlsfMetaData*)((char*)(p) - sizeof(TlsfMetaData)))->size;
+}
+
+size_t _num_free_blocks() {
+    return tlsf_allocator.num_free_blocks;
+}
+
+size_t _num_free_bytes() {
+    return tlsf_allocator.num_free_bytes;
+}
+
+size_t _num_allocated_blocks() {
+    return tlsf_allocator.total_blocks;
+}
+
+size_t _num_allocated_bytes() {
+    return tlsf_allocator.total_bytes;
+}
+
+size_t _size_meta_data() {
+    return sizeof(TlsfMetaData);
+}
+
+size_t _num_meta_data_bytes() {
+    return tlsf_allocator.total_blocks * _size_meta_data();
+}
+
+SMALLOC_ENGINE_END
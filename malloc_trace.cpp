@@ -0,0 +1,148 @@
+//
+// Allocation trace recorder of the dispatch library. Records go to a per thread buffer (mmapped, so recording never
+// touches the heap it records) and a full buffer is written out with one write() - the calls themselves only take a
+// sequence number and a timestamp.
+//
+
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "STrace.h"
+#include "Mymalloc.h"
+
+/* Records a thread buffers before writing them out */
+#define STRACE_BUFFER_RECORDS 1024
+
+/**
+ * This is a thread's record buffer - buffers are never unmapped, a thread keeps its buffer across traces
+ */
+struct STraceBuffer {
+    STraceBuffer* next;
+    uint32_t thread;
+    size_t count;
+    STraceRecord records[STRACE_BUFFER_RECORDS];
+};
+
+std::atomic<bool> strace_on(false);
+static int trace_fd = -1;
+/* Process that started the trace - a fork()ed child drops its records instead of writing them to the parent's file */
+static pid_t trace_pid = 0;
+static uint64_t start_ns = 0;
+static std::atomic<uint64_t> sequence(0);
+static std::atomic<uint32_t> num_threads(0);
+/* Every thread's buffer, so strace_stop() can write them all out */
+static std::atomic<STraceBuffer*> buffers(nullptr);
+static thread_local STraceBuffer* thread_buffer = nullptr;
+
+static uint64_t nowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+static void writeAll(const void* data, size_t bytes) {
+    const char* next = (const char*)(data);
+    while(bytes > 0) {
+        ssize_t written = write(trace_fd, next, bytes);
+        if(written <= 0) {
+            return;
+        }
+        next += written;
+        bytes -= written;
+    }
+}
+
+static void flush(STraceBuffer* buffer) {
+    if(trace_fd >= 0 and buffer->count > 0 and getpid() == trace_pid) {
+        writeAll(buffer->records, buffer->count * sizeof(STraceRecord));
+    }
+    buffer->count = 0;
+}
+
+/**
+ * The calling thread's buffer, mapped on its first record
+ * @return nullptr if it can't be mapped
+ */
+static STraceBuffer* threadBuffer() {
+    if(thread_buffer == nullptr) {
+        void* addr = mmap(NULL, sizeof(STraceBuffer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED) {
+            return nullptr;
+        }
+        STraceBuffer* buffer = (STraceBuffer*)(addr);
+        buffer->thread = num_threads.fetch_add(1);
+        buffer->count = 0;
+        buffer->next = buffers.load();
+        while(not buffers.compare_exchange_weak(buffer->next, buffer)) {
+        }
+        thread_buffer = buffer;
+    }
+    return thread_buffer;
+}
+
+void straceRecord(STraceOp op, size_t size, void* p, void* old_p, size_t alignment) {
+    STraceBuffer* buffer = threadBuffer();
+    if(buffer == nullptr) {
+        return;
+    }
+    if(buffer->count == STRACE_BUFFER_RECORDS) {
+        flush(buffer);
+    }
+    STraceRecord& record = buffer->records[buffer->count++];
+    record.sequence = sequence.fetch_add(1);
+    record.timestamp_ns = nowNs() - start_ns;
+    record.size = size;
+    record.id = (uint64_t)(uintptr_t)(p);
+    record.old_id = (uint64_t)(uintptr_t)(old_p);
+    record.thread = buffer->thread;
+    record.op = (uint16_t)(op);
+    record.alignment_shift = alignment ? (uint16_t)(__builtin_ctzll(alignment)) : 0;
+}
+
+/**
+ * Record every s* call from now on to a trace file (see STrace.h) until strace_stop() or exit.
+ * SMALLOC_TRACE=<path> starts a trace at the first allocation.
+ * @param path the file is truncated
+ * @return 1 on success, 0 if a trace is already running or path can't be opened
+ */
+int strace_start(const char* path) {
+    if(trace_fd >= 0) {
+        return 0;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        return 0;
+    }
+    STraceHeader header;
+    memcpy(header.magic, STRACE_MAGIC, sizeof(header.magic));
+    header.version = STRACE_VERSION;
+    header.record_size = sizeof(STraceRecord);
+    trace_fd = fd;
+    trace_pid = getpid();
+    writeAll(&header, sizeof(header));
+    start_ns = nowNs();
+    sequence.store(0);
+    strace_on.store(true);
+    return 1;
+}
+
+/**
+ * Stop tracing and write out every thread's buffered records - no other thread may be in an s* call meanwhile
+ */
+void strace_stop() {
+    if(trace_fd < 0) {
+        return;
+    }
+    strace_on.store(false);
+    for (STraceBuffer* buffer = buffers.load(); buffer; buffer = buffer->next) {
+        flush(buffer);
+    }
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+/* A trace still running at exit is written out */
+__attribute__((destructor)) static void stopAtExit() {
+    strace_stop();
+}
@@ -1,4 +1,5 @@
 #include <unistd.h>
+#include "SHeapIterate.h"
 
 #ifndef MALLOC3
 #define MALLOC3
@@ -13,5 +14,6 @@ size_t _num_allocated_blocks();
 size_t _num_allocated_bytes();
 size_t _num_meta_data_bytes();
 size_t _size_meta_data();
+int sheap_iterate(SHeapVisitor visitor, void *ctx);
 
 #endif
\ No newline at end of file
@@ -11,6 +11,8 @@
 //void printMemory4(void* start);
 
 #include <iostream>
+#include "SHeapIterate.h"
+#include "malloc_3.h"
 
 typedef struct stats_t {
 	size_t num_free_blocks = 0;
@@ -21,28 +23,58 @@ typedef struct stats_t {
 } stats;
 
 
-template<class T>
-void printMemory(void *start, bool onlyList) {
-	T *current = (T *) start;
+/* Most heap blocks heapBlocks() lists (a test allocates at most MAX_ALLOC at a time) */
+#define MAX_HEAP_BLOCKS 8192
+
+typedef struct heap_blocks_t {
+	SHeapBlock blocks[MAX_HEAP_BLOCKS];
+	size_t count = 0;
+
+	const SHeapBlock *begin() const { return blocks; }
+	const SHeapBlock *end() const { return blocks + count; }
+	size_t size() const { return count; }
+	const SHeapBlock &back() const { return blocks[count - 1]; }
+} heap_blocks;
+
+/* The heap (sbrk) blocks in address order, from sheap_iterate() - no copy of the engine's block header needed.
+ * They go to a static array, so collecting them allocates nothing: a growing std::vector would take memory from glibc,
+ * which moves the same program break malloc_3 grows its heap with. The array is refilled by every call */
+const heap_blocks &heapBlocks() {
+	static heap_blocks blocks;
+	blocks.count = 0;
+	sheap_iterate([](const SHeapBlock *block, void *ctx) {
+		heap_blocks &collected = *(heap_blocks *) ctx;
+		if (block->region != SHEAP_REGION_HEAP) {
+			return 0;
+		}
+		if (collected.count == MAX_HEAP_BLOCKS) {
+			std::cout << "FAIL: more than " << MAX_HEAP_BLOCKS << " heap blocks" << std::endl;
+			return 1;
+		}
+		collected.blocks[collected.count++] = *block;
+		return 0;
+	}, &blocks);
+	return blocks;
+}
+
+void printMemory(bool onlyList) {
+	const heap_blocks &blocks = heapBlocks();
 	size_t size = 0;
-	int blocks = 0;
 	if (!onlyList) {
 		std::cout << "Printing Memory List\n";
 	}
-	while (current) {
-		if (current->is_free) {
-			std::cout << "|F:" << current->size;
+	for (const SHeapBlock &block : blocks) {
+		if (block.state != SHEAP_BLOCK_USED) {
+			std::cout << "|F:" << block.size;
 		} else {
-			std::cout << "|U:" << current->size;
+			std::cout << "|U:" << block.size;
 		}
-		size += current->size;
-		blocks++;
-		current = current->next;
+		size += block.size;
 	}
 	std::cout << "|";
 	if (!onlyList) {
-		std::cout << std::endl << "Memory Info:\nNumber Of Blocks: " << blocks << "\nTotal Size (without Metadata): " << size << std::endl;
-		std::cout << "Size of Metadata: " << sizeof(T) << std::endl;
+		std::cout << std::endl << "Memory Info:\nNumber Of Blocks: " << blocks.size() << "\nTotal Size (without Metadata): " << size << std::endl;
+		std::cout << "Size of Metadata: " << _size_meta_data() << std::endl;
 	}
 }
 
@@ -55,21 +87,23 @@ void resetStats(stats &current_stats) {
 }
 
 
-template<class T>
-void updateStats(void *start, stats &current_stats, size_t bytes_mmap, int blocks_mmap) {
+void updateStats(stats &current_stats, size_t bytes_mmap, int blocks_mmap) {
 	resetStats(current_stats);
-	T *current = (T *) start;
-	while (current) {
-		current_stats.num_meta_data_bytes += sizeof(T);
-		current_stats.num_allocated_bytes += current->size;
-		current_stats.num_allocated_blocks++;
-		if (current->is_free) {
-			current_stats.num_free_blocks++;
-			current_stats.num_free_bytes += current->size;
+	sheap_iterate([](const SHeapBlock *block, void *ctx) {
+		stats &current = *(stats *) ctx;
+		if (block->region != SHEAP_REGION_HEAP) {
+			return 0;
 		}
-		current = current->next;
-	}
-	current_stats.num_meta_data_bytes += sizeof(T) * blocks_mmap;
+		current.num_meta_data_bytes += _size_meta_data();
+		current.num_allocated_bytes += block->size;
+		current.num_allocated_blocks++;
+		if (block->state != SHEAP_BLOCK_USED) {
+			current.num_free_blocks++;
+			current.num_free_bytes += block->size;
+		}
+		return 0;
+	}, &current_stats);
+	current_stats.num_meta_data_bytes += _size_meta_data() * blocks_mmap;
 	current_stats.num_allocated_bytes += bytes_mmap;
 	current_stats.num_allocated_blocks += blocks_mmap;
 }
@@ -4,10 +4,13 @@
 
 #include <cstdlib>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include "printMemoryList.h"
 #include "malloc_3.h"
 #include "colors.h"
+#include "Mymalloc.h"
+#include "SHeapStats.h"
 
 /////////////////////////////////////////////////////
 
@@ -16,22 +19,18 @@
 //if you see garbage when printing remove this line or comment it
 #define USE_COLORS
 
-// Copy your type here
-// don't change anything from the one in malloc_3.c !!not even the order of args!!!
-typedef struct MallocMetadata3 {
-    size_t size;
-    bool is_free;
-    MallocMetadata3* next;
-    MallocMetadata3* prev;
-    MallocMetadata3* next_in_bin;
-    MallocMetadata3* prev_in_bin;
-} Metadata3;
+// The heap is walked with sheap_iterate() (printMemoryList.h), so the engine's block header isn't copied here
 
 
 ///////////////////////////////////////////////////
 
 
-#define NUM_FUNC 11
+#define NUM_FUNC 16
+
+// Heap backend the tests run on (HEAP_BACKEND_SBRK / HEAP_BACKEND_RESERVED)
+#ifndef TEST_HEAP_BACKEND
+#define TEST_HEAP_BACKEND HEAP_BACKEND_SBRK
+#endif
 
 typedef std::string (*TestFunc)(void *[MAX_ALLOC]);
 
@@ -80,7 +79,7 @@ std::string allocNoFree(void *array[MAX_ALLOC]) {
     checkStats(0, 0, __LINE__);
     DO_MALLOC(array[3] = smalloc(11e6));
     checkStats(11e6, 1, __LINE__);
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -110,7 +109,7 @@ std::string allocandFree(void *array[MAX_ALLOC]) {
     }
     checkStats(0, 0, __LINE__);
 
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -163,7 +162,7 @@ std::string allocandFreeMerge(void *array[MAX_ALLOC]) {
         sfree(array[i + 7]);
         checkStats(0, 0, __LINE__);
     }
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -201,7 +200,7 @@ std::string testRealloc(void *array[MAX_ALLOC]) {
         std::cout << ((char *) array[0])[i];
     }
 
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -264,7 +263,7 @@ std::string testRealloc2(void *array[MAX_ALLOC]) {
         }
     }
 
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -294,7 +293,7 @@ std::string testWild(void *array[MAX_ALLOC]) {
     DO_MALLOC(array[MAX_ALLOC - 9] = srealloc(array[MAX_ALLOC - 9], default_block_size * 2));
     checkStats(0, 0, __LINE__);
 
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -353,7 +352,7 @@ std::string testSplitAndMerge(void *array[MAX_ALLOC]) {
     DO_MALLOC(srealloc(array[13], default_block_size + default_block_size / 3));
     checkStats(0, 0, __LINE__);
 
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -398,7 +397,7 @@ std::string testCalloc(void *array[MAX_ALLOC]) {
     }
 
 
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -410,10 +409,10 @@ std::string testFreeAllAndMerge(void *array[MAX_ALLOC]) {
     int allsize = 0;
     for (int i = 0 ; i < MAX_ALLOC ; ++i) {
         DO_MALLOC(array[i] = smalloc(i + 1));
-        allsize += i + 1 + (int) sizeof(Metadata3);
+        allsize += i + 1 + size_of_metadata;
     }
     checkStats(0, 0, __LINE__);
-    allsize -= (int) sizeof(Metadata3);
+    allsize -= size_of_metadata;
     std::string expected = "|F:" + std::to_string(allsize) + "|";
 
     for (int i = 0 ; i < MAX_ALLOC ; ++i) {
@@ -421,17 +420,17 @@ std::string testFreeAllAndMerge(void *array[MAX_ALLOC]) {
     }
     checkStats(0, 0, __LINE__);
 
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
 std::string testInit(void *array[MAX_ALLOC]) {
     std::string expected = "|F:1||U:2|";
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     checkStats(0, 0, __LINE__);
     DO_MALLOC(array[0] = smalloc(2));
     checkStats(0, 0, __LINE__);
-    printMemory<Metadata3>(memory_start_addr, true);
+    printMemory(true);
     return expected;
 }
 
@@ -457,6 +456,248 @@ std::string testBadArgs(void *array[MAX_ALLOC]) {
     return expected;
 }
 
+/**
+ * test the page heap: mid-size blocks reuse freed spans, and a region is given back once it is entirely free
+ * @param array
+ * @return
+ */
+std::string testPageHeap(void *array[MAX_ALLOC]) {
+    std::string expected = "";
+    size_t mid_size = 200 * 1024;
+    size_t big_size = 4 * 1024 * 1024;
+    SHeapStats heap_stats;
+
+    DO_MALLOC(array[0] = smalloc(mid_size));
+    DO_MALLOC(array[1] = smalloc(mid_size));
+    checkStats(2 * mid_size, 2, __LINE__);
+    sheap_stats(&heap_stats);
+    if (heap_stats.page_heap_blocks != 2 || heap_stats.mmapped_blocks != 0) {
+        std::cout << "mid-size blocks didn't come from the page heap" << std::endl;
+    }
+    sfree(array[0]);
+    checkStats(mid_size, 1, __LINE__);
+    DO_MALLOC(array[2] = smalloc(mid_size));
+    checkStats(2 * mid_size, 2, __LINE__);
+    if (array[2] != array[0]) {
+        std::cout << "page heap didn't reuse the freed span" << std::endl;
+    }
+    sfree(array[1]);
+    sfree(array[2]);
+    checkStats(0, 0, __LINE__);
+
+    // 4MB spans, 15 fit in a region - the first region is entirely free (and unmapped) once its blocks are freed
+    for (int i = 0 ; i < 20 ; ++i) {
+        DO_MALLOC(array[i] = smalloc(big_size));
+    }
+    checkStats(20 * big_size, 20, __LINE__);
+    for (int i = 0 ; i < 20 ; ++i) {
+        sfree(array[i]);
+    }
+    checkStats(0, 0, __LINE__);
+    void *first_page = (void *) ((uintptr_t) array[0] & ~(uintptr_t) (getpagesize() - 1));
+    if (msync(first_page, getpagesize(), MS_ASYNC) == 0) {
+        std::cout << "page heap kept a free region mapped" << std::endl;
+    }
+    if (msync((void *) ((uintptr_t) array[19] & ~(uintptr_t) (getpagesize() - 1)), getpagesize(), MS_ASYNC) != 0) {
+        std::cout << "page heap unmapped its last region" << std::endl;
+    }
+    // Freeing page heap blocks doesn't raise the mmap threshold
+    DO_MALLOC(array[0] = smalloc(mid_size));
+    checkStats(mid_size, 1, __LINE__);
+    return expected;
+}
+
+/**
+ * test chunked heap growth: one sbrk serves many blocks, and every block the chunk served instead of an sbrk is counted
+ * @param array
+ * @return
+ */
+std::string testSbrkChunk(void *array[MAX_ALLOC]) {
+    std::string expected = "";
+    if (!smallopt(M_SBRK_CHUNK, 64 * 1024)) {
+        std::cout << "smallopt(M_SBRK_CHUNK) failed" << std::endl;
+    }
+    size_t calls = _num_sbrk_calls();
+    size_t saved = _num_sbrk_calls_saved();
+    // Growing exactly, every block would need its own sbrk
+    for (int i = 0 ; i < MAX_ALLOC ; ++i) {
+        DO_MALLOC(array[i] = smalloc(default_block_size));
+    }
+    checkStats(0, 0, __LINE__);
+    if (_num_sbrk_calls() - calls != 1) {
+        std::cout << "chunked growth made " << _num_sbrk_calls() - calls << " sbrk calls" << std::endl;
+    }
+    if (_num_sbrk_calls_saved() - saved != MAX_ALLOC - 1) {
+        std::cout << "num_sbrk_calls_saved is not accurate: " << _num_sbrk_calls_saved() - saved << std::endl;
+    }
+    // Reusing freed blocks saves nothing
+    freeAll(array);
+    checkStats(0, 0, __LINE__);
+    for (int i = 0 ; i < MAX_ALLOC ; ++i) {
+        DO_MALLOC(array[i] = smalloc(default_block_size));
+    }
+    checkStats(0, 0, __LINE__);
+    if (_num_sbrk_calls() - calls != 1 || _num_sbrk_calls_saved() - saved != MAX_ALLOC - 1) {
+        std::cout << "reused blocks counted as saved sbrk calls" << std::endl;
+    }
+    return expected;
+}
+
+/**
+ * test the heap backend: it can't change once the heap has blocks, and the reserved region keeps the heap contiguous
+ * when something else moves the program break
+ * @param array
+ * @return
+ */
+std::string testHeapBackend(void *array[MAX_ALLOC]) {
+    std::string expected = "|U:" + default_block + "|U:" + default_block + "||F:" + block_of_2 + "|";
+    if (smallopt(M_HEAP_BACKEND, HEAP_BACKEND_SBRK) || smallopt(M_HEAP_BACKEND, HEAP_BACKEND_RESERVED) ||
+        smallopt(M_HEAP_BACKEND, 7)) {
+        std::cout << "smallopt(M_HEAP_BACKEND) changed the backend of a heap with blocks" << std::endl;
+    }
+    DO_MALLOC(array[0] = smalloc(default_block_size));
+    checkStats(0, 0, __LINE__);
+#if TEST_HEAP_BACKEND == HEAP_BACKEND_RESERVED
+    // Another sbrk user between two heap growths
+    if (sbrk(4096) == (void *) -1) {
+        std::cout << "sbrk failed" << std::endl;
+    }
+#endif
+    DO_MALLOC(array[1] = smalloc(default_block_size));
+    checkStats(0, 0, __LINE__);
+    if ((char *) array[1] != (char *) array[0] + default_block_size + size_of_metadata) {
+        std::cout << "heap blocks aren't contiguous" << std::endl;
+    }
+    printMemory(true);
+    freeAll(array);
+    checkStats(0, 0, __LINE__);
+    printMemory(true);
+    return expected;
+}
+
+/**
+ * test sreserve / sprefill: the reserved bytes join the free wilderness (prefaulted with SRESERVE_POPULATE),
+ * prefilled blocks wait split in their bin and serve allocations without growing the heap
+ * @param array
+ * @return
+ */
+std::string testReservePrefill(void *array[MAX_ALLOC]) {
+    size_t reserve_size = 64 * 1024;
+    int count = 10;
+    size_t wilderness = heapBlocks().back().size + reserve_size;
+    std::string expected = "|F:" + std::to_string(wilderness) + "|";
+    for (int i = 0 ; i < count ; ++i) {
+        expected += "|F:" + default_block;
+    }
+    expected += "|F:" + std::to_string(wilderness) + "|";
+    for (int i = 0 ; i < count ; ++i) {
+        expected += "|U:" + default_block;
+    }
+    expected += "|F:" + std::to_string(wilderness) + "|";
+
+    if (sprefill(0, count, 0) || sprefill(10e8, 1, 0) || sreserve(0, 0)) {
+        std::cout << "missed edge case: sreserve / sprefill" << std::endl;
+    }
+    if (!sreserve(reserve_size, SRESERVE_POPULATE)) {
+        std::cout << "sreserve failed" << std::endl;
+    }
+    checkStats(0, 0, __LINE__);
+    printMemory(true);
+    // The last reserved page is resident already
+    const SHeapBlock &last = heapBlocks().back();
+    unsigned char resident = 0;
+    char *last_page = (char *) ((uintptr_t) ((char *) last.payload + last.size - 1) &
+                                ~(uintptr_t) (getpagesize() - 1));
+    if (mincore(last_page, getpagesize(), &resident) != 0 || !(resident & 1)) {
+        std::cout << "SRESERVE_POPULATE didn't prefault the reserved pages" << std::endl;
+    }
+
+    if (!sprefill(default_block_size, count, 0)) {
+        std::cout << "sprefill failed" << std::endl;
+    }
+    checkStats(0, 0, __LINE__);
+    printMemory(true);
+
+    size_t calls = _num_sbrk_calls();
+    for (int i = 0 ; i < count ; ++i) {
+        DO_MALLOC(array[i] = smalloc(default_block_size));
+    }
+    checkStats(0, 0, __LINE__);
+    if (_num_sbrk_calls() != calls) {
+        std::cout << "prefilled blocks didn't serve the allocations" << std::endl;
+    }
+    printMemory(true);
+    return expected;
+}
+
+/**
+ * test deferred coalescing: frees wait unmerged (but counted as free) until the list grows past its limit,
+ * a free block of the same size goes right back out, and turning it off coalesces what is waiting
+ * @param array
+ * @return
+ */
+std::string testDeferredCoalesce(void *array[MAX_ALLOC]) {
+    std::string expected = "|U:" + default_block + "|F:" + default_block + "|F:" + default_block + "|F:" + default_block;
+    for (int i = 4 ; i < MAX_ALLOC ; ++i) {
+        expected += "|U:" + default_block;
+    }
+    expected += "||U:" + default_block + "|F:" + std::to_string(default_block_size * 5 + size_of_metadata * 4) +
+                "|U:" + default_block + "|F:" + default_block;
+    for (int i = 8 ; i < MAX_ALLOC ; ++i) {
+        expected += "|U:" + default_block;
+    }
+    expected += "|";
+
+    if (MAX_ALLOC < 10) {
+        std::cout << "Test Wont work with MAX_ALLOC < 10";
+        return expected;
+    }
+    SHeapStats heap_stats;
+    if (!smallopt(M_DEFERRED_COALESCE, 4)) {
+        std::cout << "smallopt(M_DEFERRED_COALESCE) failed" << std::endl;
+    }
+    for (int i = 0 ; i < MAX_ALLOC ; ++i) {
+        DO_MALLOC(array[i] = smalloc(default_block_size));
+    }
+    checkStats(0, 0, __LINE__);
+    for (int i = 1 ; i <= 3 ; ++i) {
+        sfree(array[i]);
+        checkStats(0, 0, __LINE__);
+    }
+    sheap_stats(&heap_stats);
+    if (heap_stats.deferred_blocks != 3 || heap_stats.deferred_bytes != 3 * (size_t) default_block_size) {
+        std::cout << "sheap_stats deferred blocks are not accurate" << std::endl;
+    }
+    printMemory(true);
+
+    // Same size - the last deferred free goes right back out
+    DO_MALLOC(array[3] = smalloc(default_block_size));
+    checkStats(0, 0, __LINE__);
+    if (_num_free_blocks() != 2) {
+        std::cout << "deferred block of the same size wasn't reused" << std::endl;
+    }
+    sfree(array[3]);
+    checkStats(0, 0, __LINE__);
+    sfree(array[4]);
+    checkStats(0, 0, __LINE__);
+    // The fifth deferred free drains the list, the neighbours merge
+    sfree(array[5]);
+    checkStats(0, 0, __LINE__);
+    sheap_stats(&heap_stats);
+    if (heap_stats.deferred_blocks != 0 || _num_free_blocks() != 1) {
+        std::cout << "deferred frees weren't consolidated" << std::endl;
+    }
+    sfree(array[7]);
+    checkStats(0, 0, __LINE__);
+    smallopt(M_DEFERRED_COALESCE, 0);
+    checkStats(0, 0, __LINE__);
+    sheap_stats(&heap_stats);
+    if (heap_stats.deferred_blocks != 0) {
+        std::cout << "smallopt(M_DEFERRED_COALESCE, 0) didn't consolidate" << std::endl;
+    }
+    printMemory(true);
+    return expected;
+}
 
 /////////////////////////////////////////////////////
 
@@ -472,9 +713,8 @@ std::string testBadArgs(void *array[MAX_ALLOC]) {
 void *getMemoryStart() {
     void *first = smalloc(1);
     if (!first) { return nullptr; }
-    void *start = (char *) first - sizeof(Metadata3);
     sfree(first);
-    return start;
+    return first;
 }
 
 void printTestName(std::string &name) {
@@ -516,14 +756,56 @@ bool checkFunc(std::string (*func)(void *[MAX_ALLOC]), void *array[MAX_ALLOC], s
 /////////////////////////////////////////////////////
 
 TestFunc functions[NUM_FUNC] = {testInit, allocNoFree, allocandFree, testFreeAllAndMerge, allocandFreeMerge, testRealloc, testRealloc2, testWild,
-                                testSplitAndMerge, testCalloc, testBadArgs};
+                                testSplitAndMerge, testCalloc, testBadArgs, testPageHeap,
+                                testSbrkChunk, testHeapBackend, testReservePrefill, testDeferredCoalesce};
 std::string function_names[NUM_FUNC] = {"testInit", "allocNoFree", "allocandFree", "testFreeAllAndMerge", "allocandFreeMerge", "testRealloc",
                                         "testRealloc2",
                                         "testWild",
-                                        "testSplitAndMerge", "testCalloc", "testBadArgs"};
+                                        "testSplitAndMerge", "testCalloc", "testBadArgs", "testPageHeap",
+                                        "testSbrkChunk", "testHeapBackend", "testReservePrefill",
+                                        "testDeferredCoalesce"};
+
+#ifdef CHECK_HEAP_STATS
+/* sheap_stats() against a walk of the block list */
+void checkHeapStats(size_t bytes_mmap, int blocks_mmap, int line_number) {
+    SHeapStats heap_stats;
+    sheap_stats(&heap_stats);
+    size_t largest = 0;
+    size_t wilderness = 0;
+    size_t binned_blocks = 0;
+    for (const SHeapBlock &block : heapBlocks()) {
+        // Deferred frees aren't in the bins yet
+        if (block.state == SHEAP_BLOCK_FREE) {
+            largest = std::max(largest, block.size);
+        }
+        wilderness = block.state != SHEAP_BLOCK_USED ? block.size : 0;
+    }
+    for (int i = 0 ; i < heap_stats.num_bins ; ++i) {
+        binned_blocks += heap_stats.bin_free_blocks[i];
+    }
+    if (heap_stats.largest_free_block != largest) {
+        std::cout << "sheap_stats largest_free_block is not accurate at line: " << line_number << std::endl;
+        std::cout << "Expected: " << largest << std::endl;
+        std::cout << "Recived:  " << heap_stats.largest_free_block << std::endl;
+    }
+    if (heap_stats.wilderness_bytes != wilderness) {
+        std::cout << "sheap_stats wilderness_bytes is not accurate at line: " << line_number << std::endl;
+    }
+    if (binned_blocks + heap_stats.deferred_blocks != current_stats.num_free_blocks or
+        heap_stats.free_bytes != current_stats.num_free_bytes) {
+        std::cout << "sheap_stats free blocks are not accurate at line: " << line_number << std::endl;
+    }
+    /* The test's mmapped blocks may come from the page heap */
+    if (heap_stats.mmapped_bytes + heap_stats.page_heap_bytes != bytes_mmap or
+        heap_stats.mmapped_blocks + heap_stats.page_heap_blocks != (size_t) blocks_mmap or
+        heap_stats.heap_bytes != current_stats.num_allocated_bytes - bytes_mmap) {
+        std::cout << "sheap_stats heap / mmapped bytes are not accurate at line: " << line_number << std::endl;
+    }
+}
+#endif
 
 void checkStats(size_t bytes_mmap, int blocks_mmap, int line_number) {
-    updateStats<Metadata3>(memory_start_addr, current_stats, bytes_mmap, blocks_mmap);
+    updateStats(current_stats, bytes_mmap, blocks_mmap);
     if (_num_allocated_blocks() != current_stats.num_allocated_blocks) {
         std::cout << "num_allocated_blocks is not accurate at line: " << line_number << std::endl;
         std::cout << "Expected: " << current_stats.num_allocated_blocks << std::endl;
@@ -549,6 +831,9 @@ void checkStats(size_t bytes_mmap, int blocks_mmap, int line_number) {
         std::cout << "Expected: " << current_stats.num_free_bytes << std::endl;
         std::cout << "Recived:  " << _num_free_bytes() << std::endl;
     }
+#ifdef CHECK_HEAP_STATS
+    checkHeapStats(bytes_mmap, blocks_mmap, line_number);
+#endif
 }
 
 
@@ -556,7 +841,7 @@ void initTests() {
     resetStats(current_stats);
     DO_MALLOC(memory_start_addr = getMemoryStart());
     checkStats(0, 0, __LINE__);
-    size_of_metadata = sizeof(Metadata3);
+    size_of_metadata = (int) _size_meta_data();
     default_block_size = 4 * (size_of_metadata + (4 * 128)); // big enough to split a lot
     if (default_block_size * 3 + size_of_metadata * 2 >= 128 * 1024) {
         default_block_size /= 2;
@@ -605,6 +890,10 @@ void printStartRunningTests() {
 
 int main() {
     void *allocations[MAX_ALLOC];
+    // The backend can only change before the first allocation
+    if (!smallopt(M_HEAP_BACKEND, TEST_HEAP_BACKEND)) {
+        std::cout << "smallopt(M_HEAP_BACKEND) FAIL" << std::endl;
+    }
     initTests();
 
     printDebugInfo();
@@ -0,0 +1,54 @@
+//
+// Shared pieces of the library tests: a failed CHECK is printed and counted, and main returns TEST_RESULT().
+// isAligned() and usedBlocks() look at the blocks of the engine in use, runForked() runs a test on a fresh heap.
+//
+
+#ifndef MEMORY_UNIT_IMPLEMENTATION_TESTHARNESS_H
+#define MEMORY_UNIT_IMPLEMENTATION_TESTHARNESS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Mymalloc.h"
+
+static int test_failures = 0;
+
+#define CHECK(condition) do { \
+    if(not (condition)) { \
+        fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #condition); \
+        test_failures++; \
+    } \
+} while(0)
+
+/* 16 - what the heap engines align payloads to */
+#define TEST_ALIGNMENT ((size_t)(16))
+
+inline bool isAligned(const void* p, size_t alignment = TEST_ALIGNMENT) {
+    return (uintptr_t)(p) % alignment == 0;
+}
+
+/* Blocks of the engine in use */
+inline size_t usedBlocks() {
+    return _num_allocated_blocks() - _num_free_blocks();
+}
+
+/**
+ * Run a test in a child process, so it starts from an empty heap and an unselected engine
+ * @return false if one of its checks failed
+ */
+inline bool runForked(void (*test)()) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        test_failures = 0;
+        test();
+        _exit(test_failures == 0 ? 0 : 1);
+    }
+    int status = 0;
+    return pid > 0 and waitpid(pid, &status, 0) == pid and WIFEXITED(status) and WEXITSTATUS(status) == 0;
+}
+
+/* 0 when every check passed */
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_TESTHARNESS_H
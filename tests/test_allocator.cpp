@@ -0,0 +1,91 @@
+//
+// SAllocator and smallocResource() on the engine $SMALLOC_ENGINE picks: a vector, an unordered_map and a pmr
+// container are filled, checked and torn down, and no block is left behind.
+//
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SAllocator.h"
+#include "TestHarness.h"
+
+void testVector() {
+    std::vector<long, SAllocator<long>> vector;
+    for (long i = 0; i < 10000; ++i) {
+        vector.push_back(i);
+        CHECK(isAligned(vector.data(), alignof(long)));
+    }
+    long sum = 0;
+    for (long i : vector) {
+        sum += i;
+    }
+    CHECK(sum == 10000L * 9999 / 2);
+    vector.resize(10);
+    vector.shrink_to_fit();
+    CHECK(vector.size() == 10 and vector.back() == 9);
+}
+
+void testUnorderedMap() {
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, SAllocator<std::pair<const int, int>>> map;
+    for (int i = 0; i < 5000; ++i) {
+        map[i] = i * 2;
+    }
+    for (int i = 0; i < 5000; i += 2) {
+        map.erase(i);
+    }
+    CHECK(map.size() == 2500);
+    bool all_found = true;
+    for (int i = 1; i < 5000; i += 2) {
+        auto found = map.find(i);
+        all_found = all_found and found != map.end() and found->second == i * 2;
+    }
+    CHECK(all_found);
+    CHECK(map.find(0) == map.end());
+}
+
+void testPmr() {
+    std::pmr::vector<std::pmr::string> strings(smallocResource());
+    for (int i = 0; i < 1000; ++i) {
+        /* Long enough to leave the small string buffer, so the characters come from the resource too */
+        strings.emplace_back(std::string(40 + i % 20, (char)('a' + i % 26)));
+    }
+    CHECK(strings.get_allocator().resource() == smallocResource());
+    CHECK(strings[27].get_allocator().resource() == smallocResource());
+    CHECK(strings[27].size() == 47 and strings[27].find_first_not_of('b') == std::pmr::string::npos);
+    SMemoryResource other;
+    CHECK(other.is_equal(*smallocResource()));
+    CHECK(not smallocResource()->is_equal(*std::pmr::new_delete_resource()));
+}
+
+struct alignas(64) CacheLine {
+    char data[64];
+};
+
+void testOverAligned() {
+    /* Only the engines with smemalign() can hand out over-aligned blocks */
+    void* probe = smemalign(64, 64);
+    sfree(probe);
+    if(probe == nullptr) {
+        bool thrown = false;
+        try {
+            std::vector<CacheLine, SAllocator<CacheLine>> lines(3);
+        }
+        catch (const std::bad_alloc&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+        return;
+    }
+    std::vector<CacheLine, SAllocator<CacheLine>> lines(3);
+    CHECK(isAligned(lines.data(), alignof(CacheLine)));
+}
+
+int main() {
+    size_t blocks = _num_allocated_blocks() - _num_free_blocks();
+    testVector();
+    testUnorderedMap();
+    testPmr();
+    testOverAligned();
+    CHECK(_num_allocated_blocks() - _num_free_blocks() == blocks);
+    return TEST_RESULT();
+}
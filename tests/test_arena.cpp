@@ -0,0 +1,103 @@
+//
+// Arenas (sarena_*) on the engine $SMALLOC_ENGINE picks: bump allocation across chunks, reset, save / restore,
+// sizes that would overflow, and destroy giving every chunk back.
+//
+
+#include <cstdint>
+#include <cstring>
+#include "Mymalloc.h"
+#include "TestHarness.h"
+
+#define CHUNK_SIZE ((size_t)(4096))
+
+void testAlloc(SArena* arena) {
+    CHECK(sarena_alloc(arena, 0) == nullptr);
+    char* previous = nullptr;
+    bool aligned = true, ordered = true;
+    /* Spans a few chunks */
+    for (size_t i = 1; i <= 200; ++i) {
+        char* p = (char*)(sarena_alloc(arena, i));
+        if(p == nullptr) {
+            CHECK(p != nullptr);
+            return;
+        }
+        memset(p, (int)(i), i);
+        aligned = aligned and isAligned(p);
+        /* Each allocation is past the previous one or in another chunk */
+        ordered = ordered and (previous == nullptr or p >= previous + i - 1 or p < previous);
+        previous = p;
+    }
+    CHECK(aligned);
+    CHECK(ordered);
+    /* Bigger than a chunk gets a chunk of its own */
+    char* big = (char*)(sarena_alloc(arena, CHUNK_SIZE * 4));
+    CHECK(big != nullptr and isAligned(big));
+    memset(big, 1, CHUNK_SIZE * 4);
+}
+
+void testOverflow(SArena* arena) {
+    SArenaMarker before = sarena_save(arena);
+    CHECK(sarena_alloc(arena, SIZE_MAX) == nullptr);
+    CHECK(sarena_alloc(arena, SIZE_MAX - 15) == nullptr);
+    CHECK(sarena_alloc(arena, SIZE_MAX - 64) == nullptr);
+    CHECK(sarena_alloc(arena, SIZE_MAX / 2) == nullptr);
+    /* The failures didn't move the arena */
+    SArenaMarker after = sarena_save(arena);
+    CHECK(after.chunk == before.chunk and after.top == before.top);
+    CHECK(sarena_alloc(arena, 16) != nullptr);
+}
+
+void testReset(SArena* arena) {
+    sarena_reset(arena);
+    void* first = sarena_alloc(arena, 32);
+    for (int i = 0; i < 100; ++i) {
+        sarena_alloc(arena, 100);
+    }
+    size_t blocks = usedBlocks();
+    sarena_reset(arena);
+    CHECK(sarena_alloc(arena, 32) == first);
+    /* The same allocations again fit in the chunks kept from before */
+    for (int i = 0; i < 100; ++i) {
+        sarena_alloc(arena, 100);
+    }
+    CHECK(usedBlocks() == blocks);
+}
+
+void testRestore(SArena* arena) {
+    sarena_reset(arena);
+    sarena_alloc(arena, 64);
+    SArenaMarker marker = sarena_save(arena);
+    void* next = sarena_alloc(arena, 48);
+    sarena_restore(arena, marker);
+    CHECK(sarena_alloc(arena, 48) == next);
+    /* Restoring to a marker in an earlier chunk */
+    sarena_restore(arena, marker);
+    for (int i = 0; i < 3 * (int)(CHUNK_SIZE / 64); ++i) {
+        sarena_alloc(arena, 64);
+    }
+    sarena_restore(arena, marker);
+    CHECK(sarena_alloc(arena, 48) == next);
+}
+
+int main() {
+    size_t blocks = usedBlocks();
+    SArena* arena = sarena_create(CHUNK_SIZE);
+    CHECK(arena != nullptr);
+    if(arena == nullptr) {
+        return TEST_RESULT();
+    }
+    testAlloc(arena);
+    testOverflow(arena);
+    testReset(arena);
+    testRestore(arena);
+    CHECK(usedBlocks() > blocks);
+    sarena_destroy(arena);
+    CHECK(usedBlocks() == blocks);
+    sarena_destroy(nullptr);
+    /* Chunk size 0 takes the default */
+    arena = sarena_create(0);
+    CHECK(arena != nullptr and sarena_alloc(arena, 1000) != nullptr);
+    sarena_destroy(arena);
+    CHECK(usedBlocks() == blocks);
+    return TEST_RESULT();
+}
@@ -0,0 +1,61 @@
+//
+// Engine selection in libsmalloc: whatever puts memory into an engine's heap locks the engine, so sengine_select()
+// can't strand that memory in it. Every case runs in a forked child, before anything else is allocated.
+//
+
+#include <cstring>
+#include "Mymalloc.h"
+#include "TestHarness.h"
+
+bool onEngine(const char* name) {
+    return strcmp(sengine_name(), name) == 0;
+}
+
+void testAllocationLocks() {
+    CHECK(sengine_select("malloc_3"));
+    CHECK(sengine_select("malloc_4"));
+    void* p = smalloc(100);
+    CHECK(not sengine_select("malloc_3"));
+    CHECK(sengine_select("malloc_4"));
+    CHECK(onEngine("malloc_4"));
+    sfree(p);
+}
+
+void testReserveLocks() {
+    CHECK(sengine_select("malloc_3"));
+    CHECK(sreserve(64 * 1024, 0));
+    CHECK(not sengine_select("malloc_4"));
+    CHECK(onEngine("malloc_3"));
+}
+
+void testPrefillLocks() {
+    CHECK(sengine_select("malloc_4"));
+    CHECK(sprefill(64, 4, 0));
+    CHECK(not sengine_select("malloc_3"));
+    CHECK(onEngine("malloc_4"));
+}
+
+void testHeapBackendLocks() {
+    CHECK(sengine_select("malloc_3"));
+    CHECK(smallopt(M_HEAP_BACKEND, HEAP_BACKEND_RESERVED));
+    CHECK(not sengine_select("malloc_4"));
+    CHECK(onEngine("malloc_3"));
+}
+
+/* Tuning doesn't touch the heap, the engine can still change */
+void testTuningDoesntLock() {
+    CHECK(sengine_select("malloc_3"));
+    CHECK(smallopt(M_MMAP_THRESHOLD, 256 * 1024));
+    CHECK(smallopt(M_SBRK_CHUNK, 64 * 1024));
+    CHECK(sengine_select("malloc_4"));
+    CHECK(onEngine("malloc_4"));
+}
+
+int main() {
+    CHECK(runForked(testAllocationLocks));
+    CHECK(runForked(testReserveLocks));
+    CHECK(runForked(testPrefillLocks));
+    CHECK(runForked(testHeapBackendLocks));
+    CHECK(runForked(testTuningDoesntLock));
+    return TEST_RESULT();
+}
@@ -0,0 +1,41 @@
+//
+// Heap growth on the engine $SMALLOC_ENGINE picks (malloc_3 / malloc_4) keeps payloads aligned, whatever grows it.
+// Every case runs in a forked child, so it starts from an empty heap.
+//
+
+#include "Mymalloc.h"
+#include "TestHarness.h"
+
+/* An unaligned M_SBRK_CHUNK - the block after the first growth starts at the break */
+void testSbrkChunk() {
+    CHECK(smallopt(M_SBRK_CHUNK, 1000));
+    void* first = smalloc(944);
+    void* second = smalloc(32);
+    CHECK(first != nullptr and isAligned(first));
+    CHECK(second != nullptr and isAligned(second));
+}
+
+/* An unaligned sreserve() - the reserved bytes join the wilderness, the block after it starts at the break */
+void testReserve() {
+    CHECK(sreserve(1000, 0));
+    void* first = smalloc(944);
+    void* second = smalloc(32);
+    CHECK(first != nullptr and isAligned(first));
+    CHECK(second != nullptr and isAligned(second));
+}
+
+/* A chunk of an arena allocation bigger than the chunk size - the block after it starts at the break */
+void testArenaChunk() {
+    SArena* arena = sarena_create(4096);
+    CHECK(arena != nullptr and sarena_alloc(arena, 8192) != nullptr);
+    void* next = smalloc(32);
+    CHECK(next != nullptr and isAligned(next));
+    sarena_destroy(arena);
+}
+
+int main() {
+    CHECK(runForked(testSbrkChunk));
+    CHECK(runForked(testReserve));
+    CHECK(runForked(testArenaChunk));
+    return TEST_RESULT();
+}
@@ -0,0 +1,106 @@
+//
+// Heap views (sheap_iterate / sheap_stats / sheap_snapshot) on the engine $SMALLOC_ENGINE picks (malloc_3 / malloc_4)
+// taken by one thread while others allocate and free under the engine lock - every view must be consistent.
+//
+
+#include <atomic>
+#include <fcntl.h>
+#include <thread>
+#include <vector>
+#include "SHeapIterate.h"
+#include "SHeapStats.h"
+#include "TestHarness.h"
+
+#define WORKERS 3
+#define WALKS 300
+/* Allocations the workers make at least while the heap is walked */
+#define OPERATIONS 200000
+
+/**
+ * This is what a walk saw
+ */
+struct Walk {
+    const char* previous = nullptr;
+    bool previous_free = false;
+    bool ordered = true;
+    bool coalesced = true;
+    bool sane = true;
+};
+
+int visit(const SHeapBlock* block, void* ctx) {
+    Walk& walk = *(Walk*)(ctx);
+    walk.sane = walk.sane and block->payload != nullptr and block->size <= (size_t)(1e8) and
+                block->state <= SHEAP_BLOCK_DEFERRED;
+    if(block->region != SHEAP_REGION_HEAP) {
+        return 0;
+    }
+    bool free_block = block->state != SHEAP_BLOCK_USED;
+    /* Heap blocks come in address order, and freeing coalesces neighbours */
+    walk.ordered = walk.ordered and (walk.previous == nullptr or (const char*)(block->payload) > walk.previous);
+    walk.coalesced = walk.coalesced and not (free_block and walk.previous_free);
+    walk.previous = (const char*)(block->payload);
+    walk.previous_free = free_block;
+    return 0;
+}
+
+std::atomic<bool> done(false);
+std::atomic<long> operations(0);
+
+void work(int t) {
+    std::vector<void*> blocks;
+    for (long i = 0; not done.load(); ++i) {
+        /* Mostly small blocks, some for the page heap and some mmapped */
+        size_t size = i % 97 == 0 ? 5 * 1024 * 1024 : i % 13 == 0 ? 200 * 1024 : 16 * (1 + (i * 7 + t) % 200);
+        sengine_lock();
+        void* p = smalloc(size);
+        sengine_unlock();
+        if(p) {
+            blocks.push_back(p);
+        }
+        operations.fetch_add(1);
+        if(blocks.size() > 200 or (i % 3 == 0 and not blocks.empty())) {
+            size_t victim = (size_t)(i * 31) % blocks.size();
+            sengine_lock();
+            sfree(blocks[victim]);
+            sengine_unlock();
+            blocks[victim] = blocks.back();
+            blocks.pop_back();
+        }
+    }
+    sengine_lock();
+    for (void* p : blocks) {
+        sfree(p);
+    }
+    sengine_unlock();
+}
+
+int main() {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < WORKERS; ++t) {
+        workers.emplace_back(work, t);
+    }
+    int null_fd = open("/dev/null", O_WRONLY);
+    bool ordered = true, coalesced = true, sane = true, stats = true, snapshots = true;
+    for (int i = 0; i < WALKS or operations.load() < OPERATIONS; ++i) {
+        Walk walk;
+        CHECK(sheap_iterate(visit, &walk));
+        ordered = ordered and walk.ordered;
+        coalesced = coalesced and walk.coalesced;
+        sane = sane and walk.sane;
+        SHeapStats heap_stats;
+        stats = stats and sheap_stats(&heap_stats) and heap_stats.free_bytes <= heap_stats.heap_bytes and
+                heap_stats.largest_free_block <= heap_stats.free_bytes;
+        snapshots = snapshots and sheap_snapshot(null_fd);
+    }
+    done.store(true);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    close(null_fd);
+    CHECK(ordered);
+    CHECK(coalesced);
+    CHECK(sane);
+    CHECK(stats);
+    CHECK(snapshots);
+    return TEST_RESULT();
+}
@@ -0,0 +1,128 @@
+//
+// operator new / delete of smalloc_new on the engine $SMALLOC_ENGINE picks:
+// default alignment, over-aligned types, sized delete, nothrow new, the new handler and threads sharing the heap.
+//
+
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <vector>
+#include "Mymalloc.h"
+#include "TestHarness.h"
+
+struct alignas(64) CacheLine {
+    char data[64];
+};
+
+void testAlignment() {
+    std::vector<char*> chars;
+    std::vector<long double*> doubles;
+    chars.reserve(64);
+    doubles.reserve(64);
+    /* Odd sizes in between must not push the next block off the alignment */
+    for (size_t i = 1; i <= 64; ++i) {
+        chars.push_back(new char[i]);
+        doubles.push_back(new long double(i));
+        CHECK(isAligned(chars.back(), __STDCPP_DEFAULT_NEW_ALIGNMENT__));
+        CHECK(isAligned(doubles.back(), alignof(long double)));
+    }
+    for (size_t i = 0; i < chars.size(); ++i) {
+        delete[] chars[i];
+        delete doubles[i];
+    }
+    CacheLine* line = new CacheLine;
+    CHECK(isAligned(line, alignof(CacheLine)));
+    delete line;
+    CacheLine* lines = new CacheLine[3];
+    CHECK(isAligned(lines, alignof(CacheLine)));
+    delete[] lines;
+}
+
+void testSizedDelete() {
+    void* p = ::operator new(100);
+    ::operator delete(p, 100);
+    /* The freed block serves the next request of the size */
+    void* q = ::operator new(100);
+    CHECK(q == p);
+    ::operator delete(q, 100);
+}
+
+int handler_calls = 0;
+
+void outOfMemory() {
+    handler_calls++;
+    std::set_new_handler(nullptr);
+}
+
+void testOutOfMemory() {
+    /* More than any engine hands out */
+    size_t huge = SIZE_MAX / 2;
+    CHECK(new(std::nothrow) char[huge] == nullptr);
+    CHECK(::operator new(huge, std::nothrow) == nullptr);
+    bool thrown = false;
+    try {
+        char* p = new char[huge];
+        delete[] p;
+    }
+    catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    /* The new handler runs before bad_alloc is thrown */
+    std::set_new_handler(outOfMemory);
+    thrown = false;
+    try {
+        ::operator delete(::operator new(huge));
+    }
+    catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(handler_calls == 1);
+    thrown = false;
+    try {
+        ::operator delete(::operator new(SIZE_MAX));
+    }
+    catch (const std::bad_alloc&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+void testThreads() {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t]() {
+            std::vector<int*> blocks;
+            for (int i = 0; i < 20000; ++i) {
+                blocks.push_back(new int[1 + (i * 7 + t) % 300]);
+                blocks.back()[0] = i;
+                if(i % 3 == 0) {
+                    CHECK(blocks.front()[0] >= 0);
+                    delete[] blocks.front();
+                    blocks.erase(blocks.begin());
+                }
+                if(blocks.size() > 64) {
+                    for (int* block : blocks) {
+                        delete[] block;
+                    }
+                    blocks.clear();
+                }
+            }
+            for (int* block : blocks) {
+                delete[] block;
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+int main() {
+    testAlignment();
+    testSizedDelete();
+    testOutOfMemory();
+    testThreads();
+    return TEST_RESULT();
+}
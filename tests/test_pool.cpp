@@ -0,0 +1,160 @@
+//
+// SPool on the engine $SMALLOC_ENGINE picks: create / destroy, giving empty slabs back (by shrink() and on its own)
+// and threads churning one pool.
+//
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "SPool.h"
+#include "TestHarness.h"
+
+#define OBJECTS 2000
+
+std::atomic<int> alive(0);
+
+struct Object {
+    long values[3];
+
+    explicit Object(long value) : values{value, value + 1, value + 2} {
+        if(value < 0) {
+            throw std::runtime_error("negative");
+        }
+        alive++;
+    }
+
+    ~Object() {
+        alive--;
+    }
+
+    bool intact(long value) const {
+        return values[0] == value and values[1] == value + 1 and values[2] == value + 2;
+    }
+};
+
+void testCreateDestroy() {
+    SPool<Object> pool;
+    Object* object = pool.create(7);
+    CHECK(object->intact(7) and alive == 1);
+    pool.destroy(object);
+    CHECK(alive == 0);
+    pool.destroy(nullptr);
+    /* The slot of a constructor that threw is free again */
+    bool thrown = false;
+    try {
+        pool.create(-1);
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    Object* again = pool.create(8);
+    CHECK(again == object);
+    CHECK(pool.numSlabs() == 1);
+    pool.destroy(again);
+}
+
+void testShrink() {
+    size_t blocks = usedBlocks();
+    {
+        SPool<Object> pool;
+        std::vector<Object*> objects;
+        for (long i = 0; i < OBJECTS; ++i) {
+            objects.push_back(pool.create(i));
+        }
+        size_t slabs = pool.numSlabs();
+        CHECK(slabs >= OBJECTS / 64);
+        /* Every other object - no slab empties */
+        for (size_t i = 0; i < objects.size(); i += 2) {
+            pool.destroy(objects[i]);
+        }
+        CHECK(pool.numSlabs() == slabs);
+        /* The rest - the slabs go back as they empty */
+        bool intact = true;
+        for (size_t i = 1; i < objects.size(); i += 2) {
+            intact = intact and objects[i]->intact((long)(i));
+            pool.destroy(objects[i]);
+        }
+        CHECK(intact);
+        CHECK(alive == 0);
+        CHECK(pool.numSlabs() < slabs / 2);
+        /* What is left is held by the slots in this thread's magazine (32, from the last slabs emptied) */
+        pool.shrink();
+        CHECK(pool.numSlabs() <= 2);
+        /* And it grows again */
+        objects.clear();
+        for (long i = 0; i < OBJECTS; ++i) {
+            objects.push_back(pool.create(i));
+        }
+        CHECK(pool.numSlabs() >= OBJECTS / 64);
+        for (Object* object : objects) {
+            pool.destroy(object);
+        }
+    }
+    CHECK(usedBlocks() == blocks);
+}
+
+/**
+ * Create and destroy objects of pool in waves of growing and emptying, so slabs come and go
+ * @return false if an object changed while it was alive
+ */
+template<class Pool>
+bool churn(Pool& pool, int t) {
+    bool intact = true;
+    std::vector<std::pair<Object*, long>> objects;
+    for (long i = 0; i < 50000; ++i) {
+        objects.emplace_back(pool.create(i), i);
+        bool emptying = (i / 1500 + t) % 2 == 1;
+        if(emptying or i % 3 == 0) {
+            for (int j = 0; j < 2 and not objects.empty(); ++j) {
+                size_t victim = (size_t)(i * 31 + j) % objects.size();
+                intact = intact and objects[victim].first->intact(objects[victim].second);
+                pool.destroy(objects[victim].first);
+                objects[victim] = objects.back();
+                objects.pop_back();
+            }
+        }
+    }
+    for (std::pair<Object*, long>& object : objects) {
+        intact = intact and object.first->intact(object.second);
+        pool.destroy(object.first);
+    }
+    return intact;
+}
+
+void testThreads() {
+    size_t blocks = usedBlocks();
+    {
+        /* Two pools of different types at once - their slabs come from the same engine */
+        SPool<Object> pool;
+        SPool<Object, 16> other;
+        std::vector<std::thread> threads;
+        bool intact[4];
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]() {
+                intact[t] = t % 2 == 0 ? churn(pool, t) : churn(other, t);
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        for (int t = 0; t < 4; ++t) {
+            CHECK(intact[t]);
+        }
+        CHECK(alive == 0);
+        /* Only slots left in the finished threads' magazines keep slabs - a slab each at most */
+        pool.shrink();
+        other.shrink();
+        CHECK(pool.numSlabs() <= 2 * 32);
+        CHECK(other.numSlabs() <= 2 * 32);
+    }
+    CHECK(usedBlocks() == blocks);
+}
+
+int main() {
+    testCreateDestroy();
+    testShrink();
+    testThreads();
+    return TEST_RESULT();
+}
@@ -0,0 +1,81 @@
+//
+// The libc allocation API as the LD_PRELOAD shim (libsmalloc.so) serves it - run under
+//     LD_PRELOAD=libsmalloc.so SMALLOC_ENGINE=<engine> test_preload
+// Requests above the engines' 1e8 byte cap are mapped by the shim itself.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <malloc.h>
+#include "TestHarness.h"
+
+#define BIG_SIZE ((size_t)(200 * 1024 * 1024))
+
+/* Some bytes spread over a big block */
+bool filled(const char* p, size_t size, char value) {
+    for (size_t i = 0; i < size; i += 4096) {
+        if(p[i] != value) {
+            return false;
+        }
+    }
+    return p[size - 1] == value;
+}
+
+void testBigMalloc() {
+    char* p = (char*)(malloc(BIG_SIZE));
+    CHECK(p != nullptr and isAligned(p));
+    if(p == nullptr) {
+        return;
+    }
+    memset(p, 'a', BIG_SIZE);
+    CHECK(malloc_usable_size(p) >= BIG_SIZE);
+    /* Growing and shrinking keep the payload */
+    p = (char*)(realloc(p, BIG_SIZE + BIG_SIZE / 2));
+    CHECK(p != nullptr and filled(p, BIG_SIZE, 'a'));
+    p = (char*)(realloc(p, 4096));
+    CHECK(p != nullptr and filled(p, 4096, 'a'));
+    CHECK(malloc_usable_size(p) < BIG_SIZE);
+    /* And out of the engine again */
+    p = (char*)(realloc(p, BIG_SIZE));
+    CHECK(p != nullptr and filled(p, 4096, 'a'));
+    free(p);
+}
+
+void testBigCalloc() {
+    char* p = (char*)(calloc(BIG_SIZE / 8, 8));
+    CHECK(p != nullptr and filled(p, BIG_SIZE, 0));
+    free(p);
+}
+
+void testBigAligned() {
+    void* p = nullptr;
+    CHECK(posix_memalign(&p, 1 << 16, BIG_SIZE) == 0);
+    CHECK(p != nullptr and isAligned(p, 1 << 16));
+    free(p);
+    p = aligned_alloc(64, BIG_SIZE);
+    CHECK(p != nullptr and isAligned(p, 64));
+    free(p);
+}
+
+void testSmall() {
+    void* blocks[100];
+    for (int i = 0; i < 100; ++i) {
+        blocks[i] = malloc(1 + i * 37);
+        CHECK(blocks[i] != nullptr and isAligned(blocks[i]));
+    }
+    for (void* block : blocks) {
+        free(block);
+    }
+}
+
+int main() {
+    /* malloc is the shim's */
+    Dl_info info;
+    CHECK(dladdr(dlsym(RTLD_DEFAULT, "malloc"), &info) and strstr(info.dli_fname, "libsmalloc") != nullptr);
+    testBigMalloc();
+    testBigCalloc();
+    testBigAligned();
+    testSmall();
+    return TEST_RESULT();
+}
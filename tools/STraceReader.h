@@ -0,0 +1,150 @@
+#ifndef MEMORY_UNIT_IMPLEMENTATION_STRACEREADER_H
+#define MEMORY_UNIT_IMPLEMENTATION_STRACEREADER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "STrace.h"
+
+/*
+ * Loading an allocation trace (STrace.h) for the tools that play it: the records in call order, with the recorded
+ * addresses turned into slots of one array.
+ */
+
+/* Slot of an operation the replay skips */
+#define NO_SLOT UINT32_MAX
+
+/**
+ * This is a trace record resolved for the replay - objects are slots of one array instead of recorded addresses
+ */
+struct ReplayOp {
+    uint64_t size;
+    uint32_t slot;
+    /* srealloc - the slot of the object it was given, NO_SLOT for srealloc(nullptr) */
+    uint32_t old_slot;
+    uint16_t op;
+    uint16_t alignment_shift;
+};
+
+/**
+ * This is a trace ready to replay
+ */
+struct Replay {
+    std::vector<ReplayOp> ops;
+    size_t num_slots = 0;
+    /* Records that don't pair with anything in the trace (objects allocated before it started, failed calls) */
+    size_t skipped = 0;
+};
+
+/**
+ * Read a trace, order its records by sequence and turn the recorded addresses into slots (a slot is reused once its
+ * object is freed, so there are as many slots as there were live objects at the peak)
+ * @return false if path isn't a trace
+ */
+inline bool loadTrace(const char* path, Replay& replay) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 or fstat(fd, &st) != 0 or (size_t)(st.st_size) < sizeof(STraceHeader)) {
+        return false;
+    }
+    void* addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        return false;
+    }
+    STraceHeader* header = (STraceHeader*)(addr);
+    if(memcmp(header->magic, STRACE_MAGIC, sizeof(header->magic)) != 0 or header->version != STRACE_VERSION or
+       header->record_size != sizeof(STraceRecord)) {
+        return false;
+    }
+    STraceRecord* records = (STraceRecord*)(header + 1);
+    size_t num_records = (st.st_size - sizeof(STraceHeader)) / sizeof(STraceRecord);
+    std::sort(records, records + num_records, [](const STraceRecord& a, const STraceRecord& b) {
+        return a.sequence < b.sequence;
+    });
+
+    std::unordered_map<uint64_t, uint32_t> live;
+    std::vector<uint32_t> free_slots;
+    auto newSlot = [&](uint64_t id) {
+        uint32_t slot;
+        if(free_slots.empty()) {
+            slot = (uint32_t)(replay.num_slots++);
+        }
+        else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        live[id] = slot;
+        return slot;
+    };
+    /* Slot of a live object, NO_SLOT (and forgotten) if the trace never allocated it */
+    auto takeSlot = [&](uint64_t id) {
+        auto it = live.find(id);
+        if(it == live.end()) {
+            return NO_SLOT;
+        }
+        uint32_t slot = it->second;
+        live.erase(it);
+        return slot;
+    };
+
+    replay.ops.reserve(num_records);
+    for (size_t i = 0; i < num_records; ++i) {
+        const STraceRecord& record = records[i];
+        ReplayOp op = {record.size, NO_SLOT, NO_SLOT, record.op, record.alignment_shift};
+        switch (record.op) {
+            case STRACE_MALLOC:
+            case STRACE_CALLOC:
+            case STRACE_MEMALIGN:
+                if(record.id) {
+                    op.slot = newSlot(record.id);
+                }
+                break;
+            case STRACE_FREE:
+                if(record.id) {
+                    op.slot = takeSlot(record.id);
+                    if(op.slot != NO_SLOT) {
+                        free_slots.push_back(op.slot);
+                    }
+                }
+                break;
+            case STRACE_REALLOC:
+                if(record.id == 0) {
+                    /* Failed - the object stays where it was */
+                    break;
+                }
+                if(record.old_id) {
+                    op.old_slot = takeSlot(record.old_id);
+                    if(op.old_slot == NO_SLOT) {
+                        /* Reallocated an object from before the trace - replay what it became as an allocation */
+                        op.op = STRACE_MALLOC;
+                    }
+                }
+                if(op.old_slot != NO_SLOT) {
+                    op.slot = op.old_slot;
+                    live[record.id] = op.slot;
+                }
+                else {
+                    op.slot = newSlot(record.id);
+                }
+                break;
+            default:
+                break;
+        }
+        if(op.slot == NO_SLOT) {
+            replay.skipped++;
+        }
+        else {
+            replay.ops.push_back(op);
+        }
+    }
+    munmap(addr, st.st_size);
+    return true;
+}
+
+#endif //MEMORY_UNIT_IMPLEMENTATION_STRACEREADER_H
@@ -0,0 +1,192 @@
+//
+// Compares two heap snapshots (see SHeapSnapshot.h, written by sheap_snapshot()):
+//     sheap_diff before.snap after.snap
+// Prints how the heap's totals moved, which size classes (bins) grew or shrank, and the fragmentation holes that formed
+// in between - free blocks below the wilderness that weren't free blocks before.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "SHeapSnapshot.h"
+
+/* Rows of the size class and hole tables */
+#define MAX_ROWS 20
+
+struct Snapshot {
+    SHeapSnapshotHeader header;
+    std::vector<SHeapSnapshotRecord> blocks;
+};
+
+static bool loadSnapshot(const char* path, Snapshot& snapshot) {
+    FILE* file = fopen(path, "rb");
+    if(file == nullptr) {
+        return false;
+    }
+    bool ok = fread(&snapshot.header, sizeof(snapshot.header), 1, file) == 1 and
+              memcmp(snapshot.header.magic, SHEAP_SNAPSHOT_MAGIC, sizeof(snapshot.header.magic)) == 0 and
+              snapshot.header.version == SHEAP_SNAPSHOT_VERSION and
+              snapshot.header.record_size == sizeof(SHeapSnapshotRecord);
+    SHeapSnapshotRecord record;
+    while(ok and fread(&record, sizeof(record), 1, file) == 1) {
+        snapshot.blocks.push_back(record);
+    }
+    fclose(file);
+    return ok;
+}
+
+inline bool isFree(const SHeapSnapshotRecord& block) {
+    return block.state != SHEAP_BLOCK_USED;
+}
+
+/**
+ * This is what a snapshot adds up to
+ */
+struct Summary {
+    /* Blocks with their headers */
+    size_t heap_bytes = 0;
+    size_t used_blocks = 0;
+    size_t used_bytes = 0;
+    size_t free_blocks = 0;
+    size_t free_bytes = 0;
+    size_t largest_free_block = 0;
+    size_t wilderness_bytes = 0;
+    /* Used blocks and bytes per bin */
+    std::vector<size_t> bin_blocks;
+    std::vector<size_t> bin_bytes;
+};
+
+static Summary summarize(const Snapshot& snapshot, size_t num_bins) {
+    Summary summary;
+    summary.bin_blocks.assign(num_bins, 0);
+    summary.bin_bytes.assign(num_bins, 0);
+    for (const SHeapSnapshotRecord& block : snapshot.blocks) {
+        summary.heap_bytes += snapshot.header.meta_data_size + block.size;
+        if(isFree(block)) {
+            summary.free_blocks++;
+            summary.free_bytes += block.size;
+            summary.largest_free_block = std::max(summary.largest_free_block, (size_t)(block.size));
+            continue;
+        }
+        summary.used_blocks++;
+        summary.used_bytes += block.size;
+        summary.bin_blocks[block.bin]++;
+        summary.bin_bytes[block.bin] += block.size;
+    }
+    if(not snapshot.blocks.empty() and isFree(snapshot.blocks.back())) {
+        summary.wilderness_bytes = snapshot.blocks.back().size;
+    }
+    return summary;
+}
+
+static void printRow(const char* name, size_t before, size_t after) {
+    printf("%-24s %16zu %16zu %+16lld\n", name, before, after, (long long)(after) - (long long)(before));
+}
+
+static double fragmentation(const Summary& summary) {
+    return summary.free_bytes ? 1 - (double)(summary.largest_free_block) / summary.free_bytes : 0;
+}
+
+/**
+ * Free blocks of after (but its wilderness) with no free block of the same address and size in before -
+ * both lists are address ordered, so one merge-like pass finds them
+ */
+static std::vector<SHeapSnapshotRecord> newHoles(const Snapshot& before, const Snapshot& after) {
+    std::vector<SHeapSnapshotRecord> holes;
+    size_t j = 0;
+    for (size_t i = 0; i + 1 < after.blocks.size(); ++i) {
+        const SHeapSnapshotRecord& block = after.blocks[i];
+        if(not isFree(block)) {
+            continue;
+        }
+        while(j < before.blocks.size() and before.blocks[j].address < block.address) {
+            j++;
+        }
+        bool was_free = j < before.blocks.size() and before.blocks[j].address == block.address and
+                        before.blocks[j].size == block.size and isFree(before.blocks[j]);
+        if(not was_free) {
+            holes.push_back(block);
+        }
+    }
+    return holes;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <before snapshot> <after snapshot>\n", argv[0]);
+        return 2;
+    }
+    Snapshot before, after;
+    if(not loadSnapshot(argv[1], before) or not loadSnapshot(argv[2], after)) {
+        fprintf(stderr, "%s: not a snapshot\n", loadSnapshot(argv[1], before) ? argv[2] : argv[1]);
+        return 1;
+    }
+    size_t num_bins = 1;
+    for (const Snapshot* snapshot : {&before, &after}) {
+        for (const SHeapSnapshotRecord& block : snapshot->blocks) {
+            num_bins = std::max(num_bins, (size_t)(block.bin) + 1);
+        }
+    }
+    Summary old_summary = summarize(before, num_bins);
+    Summary new_summary = summarize(after, num_bins);
+
+    printf("%-24s %16s %16s %16s\n", "", "BEFORE", "AFTER", "DELTA");
+    printRow("heap bytes", old_summary.heap_bytes, new_summary.heap_bytes);
+    printRow("used blocks", old_summary.used_blocks, new_summary.used_blocks);
+    printRow("used bytes", old_summary.used_bytes, new_summary.used_bytes);
+    printRow("free blocks", old_summary.free_blocks, new_summary.free_blocks);
+    printRow("free bytes", old_summary.free_bytes, new_summary.free_bytes);
+    printRow("largest free block", old_summary.largest_free_block, new_summary.largest_free_block);
+    printRow("wilderness bytes", old_summary.wilderness_bytes, new_summary.wilderness_bytes);
+    printRow("mmapped blocks", before.header.mmapped_blocks, after.header.mmapped_blocks);
+    printRow("mmapped bytes", before.header.mmapped_bytes, after.header.mmapped_bytes);
+    printRow("page heap blocks", before.header.page_heap_blocks, after.header.page_heap_blocks);
+    printRow("page heap bytes", before.header.page_heap_bytes, after.header.page_heap_bytes);
+    /* Share of the free bytes outside the largest free block */
+    printf("%-24s %16.4f %16.4f %+16.4f\n", "fragmentation", fragmentation(old_summary), fragmentation(new_summary),
+           fragmentation(new_summary) - fragmentation(old_summary));
+
+    /* Size classes that changed the most (by used bytes) first */
+    std::vector<size_t> bins;
+    for (size_t bin = 0; bin < num_bins; ++bin) {
+        if(old_summary.bin_blocks[bin] != new_summary.bin_blocks[bin] or
+           old_summary.bin_bytes[bin] != new_summary.bin_bytes[bin]) {
+            bins.push_back(bin);
+        }
+    }
+    auto bytesDelta = [&](size_t bin) {
+        return std::abs((long long)(new_summary.bin_bytes[bin]) - (long long)(old_summary.bin_bytes[bin]));
+    };
+    std::stable_sort(bins.begin(), bins.end(), [&](size_t a, size_t b) { return bytesDelta(a) > bytesDelta(b); });
+    printf("\n%zu size classes changed\n", bins.size());
+    printf("%-12s %12s %12s %12s %16s %16s %16s\n", "BIN (KB)", "USED BEFORE", "USED AFTER", "DELTA",
+           "BYTES BEFORE", "BYTES AFTER", "DELTA");
+    for (size_t i = 0; i < bins.size() and i < MAX_ROWS; ++i) {
+        size_t bin = bins[i];
+        char name[32];
+        snprintf(name, sizeof(name), bin + 1 == num_bins ? "%zu+" : "%zu", bin);
+        printf("%-12s %12zu %12zu %+12lld %16zu %16zu %+16lld\n", name, old_summary.bin_blocks[bin],
+               new_summary.bin_blocks[bin],
+               (long long)(new_summary.bin_blocks[bin]) - (long long)(old_summary.bin_blocks[bin]),
+               old_summary.bin_bytes[bin], new_summary.bin_bytes[bin],
+               (long long)(new_summary.bin_bytes[bin]) - (long long)(old_summary.bin_bytes[bin]));
+    }
+
+    /* Biggest new holes first */
+    std::vector<SHeapSnapshotRecord> holes = newHoles(before, after);
+    size_t hole_bytes = 0;
+    for (const SHeapSnapshotRecord& hole : holes) {
+        hole_bytes += hole.size;
+    }
+    std::stable_sort(holes.begin(), holes.end(),
+                     [](const SHeapSnapshotRecord& a, const SHeapSnapshotRecord& b) { return a.size > b.size; });
+    printf("\n%zu new holes, %zu bytes (free blocks below the wilderness that weren't free before)\n", holes.size(),
+           hole_bytes);
+    printf("%-20s %16s %10s\n", "ADDRESS", "SIZE", "STATE");
+    for (size_t i = 0; i < holes.size() and i < MAX_ROWS; ++i) {
+        printf("0x%-18llx %16llu %10s\n", (unsigned long long)(holes[i].address), (unsigned long long)(holes[i].size),
+               holes[i].state == SHEAP_BLOCK_DEFERRED ? "deferred" : "free");
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+//
+// Replays an allocation trace (see STrace.h) on an engine of the dispatch library:
+//     SMALLOC_TRACE=app.trace LD_PRELOAD=libsmalloc.so ./app
+//     strace_replay app.trace [engine] [snapshot]
+// The calls are replayed on one thread in the order they were made (by sequence), so every replay of a trace is the
+// same. Prints a JSON line: replay time, peak heap (_num_allocated_bytes) and how fragmented the heap was at that peak.
+// With a snapshot path the heap left at the end of the replay is written there (sheap_snapshot()).
+//
+
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include "STraceReader.h"
+#include "Mymalloc.h"
+
+static void* mapArray(size_t bytes) {
+    void* addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return addr == MAP_FAILED ? nullptr : addr;
+}
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * This is what a replay measured
+ */
+struct ReplayResult {
+    uint64_t elapsed_ns;
+    size_t failed;
+    size_t peak_allocated_bytes;
+    size_t peak_live_bytes;
+    /* At the peak of _num_allocated_bytes */
+    size_t free_bytes_at_peak;
+    size_t live_bytes_at_peak;
+    size_t meta_data_bytes_at_peak;
+};
+
+/**
+ * Run the operations on the selected engine
+ * @param with_stats also follow the engine's statistics after every call (slower, so not timed)
+ */
+static bool runReplay(const Replay& replay, bool with_stats, ReplayResult& result) {
+    void** objects = (void**)(mapArray(std::max(replay.num_slots, (size_t)(1)) * sizeof(void*)));
+    size_t* sizes = (size_t*)(mapArray(std::max(replay.num_slots, (size_t)(1)) * sizeof(size_t)));
+    if(not objects or not sizes) {
+        return false;
+    }
+    memset(&result, 0, sizeof(result));
+    size_t live_bytes = 0;
+    uint64_t start = nowNs();
+    for (const ReplayOp& op : replay.ops) {
+        void* p;
+        switch (op.op) {
+            case STRACE_MALLOC:
+                p = objects[op.slot] = smalloc(op.size);
+                break;
+            case STRACE_CALLOC:
+                p = objects[op.slot] = scalloc(1, op.size);
+                break;
+            case STRACE_MEMALIGN:
+                p = objects[op.slot] = smemalign((size_t)(1) << op.alignment_shift, op.size);
+                break;
+            case STRACE_REALLOC:
+                p = srealloc(op.old_slot == NO_SLOT ? nullptr : objects[op.old_slot], op.size);
+                if(p) {
+                    objects[op.slot] = p;
+                }
+                break;
+            default:
+                sfree(objects[op.slot]);
+                objects[op.slot] = nullptr;
+                p = nullptr;
+                break;
+        }
+        if(op.op != STRACE_FREE and p == nullptr) {
+            result.failed++;
+        }
+        if(with_stats) {
+            if(p or op.op == STRACE_FREE) {
+                live_bytes -= sizes[op.slot];
+                sizes[op.slot] = p ? op.size : 0;
+                live_bytes += sizes[op.slot];
+            }
+            result.peak_live_bytes = std::max(result.peak_live_bytes, live_bytes);
+            size_t allocated_bytes = _num_allocated_bytes();
+            if(allocated_bytes > result.peak_allocated_bytes) {
+                result.peak_allocated_bytes = allocated_bytes;
+                result.free_bytes_at_peak = _num_free_bytes();
+                result.live_bytes_at_peak = live_bytes;
+                result.meta_data_bytes_at_peak = _num_meta_data_bytes();
+            }
+        }
+    }
+    result.elapsed_ns = nowNs() - start;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s <trace> [engine] [snapshot]\n", argv[0]);
+        return 2;
+    }
+    if(argc > 2 and not sengine_select(argv[2])) {
+        fprintf(stderr, "no engine %s\n", argv[2]);
+        return 2;
+    }
+    Replay replay;
+    if(not loadTrace(argv[1], replay)) {
+        fprintf(stderr, "%s: not a trace\n", argv[1]);
+        return 1;
+    }
+
+    /* The timed replay runs in a child so the one that follows the statistics starts from the same (empty) heap */
+    int fds[2];
+    if(pipe(fds) != 0) {
+        return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        ReplayResult timed;
+        bool ok = runReplay(replay, false, timed);
+        ok = ok and write(fds[1], &timed.elapsed_ns, sizeof(timed.elapsed_ns)) == sizeof(timed.elapsed_ns);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    uint64_t elapsed_ns = 0;
+    bool timed_ok = pid > 0 and read(fds[0], &elapsed_ns, sizeof(elapsed_ns)) == sizeof(elapsed_ns);
+    close(fds[0]);
+    if(pid > 0) {
+        waitpid(pid, nullptr, 0);
+    }
+    ReplayResult result;
+    if(not timed_ok or not runReplay(replay, true, result)) {
+        fprintf(stderr, "replay failed\n");
+        return 1;
+    }
+    if(argc > 3) {
+        int fd = open(argv[3], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0 or not sheap_snapshot(fd)) {
+            fprintf(stderr, "%s: can't write a snapshot of %s\n", argv[3], sengine_name());
+            return 1;
+        }
+        close(fd);
+    }
+
+    size_t num_ops = replay.ops.size();
+    size_t heap_bytes = result.peak_allocated_bytes + result.meta_data_bytes_at_peak;
+    printf("{\"engine\": \"%s\", \"ops\": %zu, \"skipped\": %zu, \"failed\": %zu, \"max_live_objects\": %zu, "
+           "\"time_ns\": %llu, \"ns_per_op\": %.1f, \"peak_allocated_bytes\": %zu, \"peak_live_bytes\": %zu, "
+           "\"free_bytes_at_peak\": %zu, \"fragmentation\": %.4f, \"overhead\": %.4f}\n",
+           sengine_name(), num_ops, replay.skipped, result.failed, replay.num_slots,
+           (unsigned long long)(elapsed_ns), num_ops ? (double)(elapsed_ns) / num_ops : 0,
+           result.peak_allocated_bytes, result.peak_live_bytes, result.free_bytes_at_peak,
+           /* Share of the peak heap sitting in free blocks, and heap (with headers) per live byte asked for */
+           result.peak_allocated_bytes ? (double)(result.free_bytes_at_peak) / result.peak_allocated_bytes : 0,
+           result.live_bytes_at_peak ? (double)(heap_bytes) / result.live_bytes_at_peak : 0);
+    return 0;
+}
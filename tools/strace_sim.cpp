@@ -0,0 +1,161 @@
+//
+// Offline heap simulator: plays an allocation trace (see STrace.h) straight on BlockMetaDataList heap layouts,
+// without the engines around them, to compare placement / split policies and bin layouts on a real workload:
+//     strace_sim app.trace
+// Every layout gets its own reserved-region heap (MAP_NORESERVE), payloads are never written, so the only memory
+// a simulation commits is the pages block headers land on. srealloc is played as in place when the block is big
+// enough and as allocate + free otherwise (the engines' merging with neighbours isn't simulated).
+//
+
+#include <cstdio>
+#include "BlockMetaDataList.h"
+#include "STraceReader.h"
+
+/**
+ * Placement policy wrapper that counts what the policy costs: blocks a search walks past and comparisons
+ * insertBlockToBinList makes to keep a bin ordered
+ */
+template<class Inner>
+struct Counted : Inner {
+    static size_t insert_steps;
+    size_t searches = 0;
+    size_t search_steps = 0;
+
+    static bool insertBefore(MallocMetaData* existing, MallocMetaData* block) {
+        insert_steps++;
+        return Inner::insertBefore(existing, block);
+    }
+
+    /* Steps are the blocks a walk from min_bin goes through up to the block handed out (all of them on a miss) */
+    MallocMetaData* search(MallocMetaData* const* head, int min_bin, int bin_num, size_t size) {
+        MallocMetaData* found = Inner::search(head, min_bin, bin_num, size);
+        searches++;
+        for (int i = min_bin; i < bin_num; ++i) {
+            for (MallocMetaData* ptr = head[i]; ptr; ptr = ptr->next_in_bin) {
+                search_steps++;
+                if(ptr == found) {
+                    return found;
+                }
+            }
+        }
+        return found;
+    }
+};
+template<class Inner>
+size_t Counted<Inner>::insert_steps = 0;
+
+struct SimResult {
+    size_t failed;
+    /* Heap (and mmapped blocks) with headers, at its peak */
+    size_t peak_heap_bytes;
+    size_t free_bytes_at_peak;
+    size_t live_bytes_at_peak;
+    /* Heap growths and how far the break moved */
+    size_t num_growths;
+    size_t grown_bytes;
+    size_t searches;
+    size_t search_steps;
+    size_t insert_steps;
+};
+
+template<class List>
+SimResult simulate(const Replay& replay) {
+    static List list;
+    list.heap_backend = HEAP_BACKEND_RESERVED;
+    list.placement.insert_steps = 0;
+    std::vector<MallocMetaData*> blocks(replay.num_slots, nullptr);
+    std::vector<size_t> sizes(replay.num_slots, 0);
+    SimResult result = {};
+    size_t live_bytes = 0;
+
+    for (const ReplayOp& op : replay.ops) {
+        MallocMetaData*& block = blocks[op.slot];
+        MallocMetaData* old = op.old_slot == NO_SLOT ? nullptr : blocks[op.old_slot];
+        switch (op.op) {
+            case STRACE_MALLOC:
+            case STRACE_CALLOC:
+                block = list.allocateBlock(op.size, DISABLE_WILDERNESS_EXTEND);
+                break;
+            case STRACE_MEMALIGN:
+                block = list.allocateAlignedBlock(op.size, (size_t)(1) << op.alignment_shift);
+                break;
+            case STRACE_REALLOC:
+                if(old and not old->is_mmapped and op.size <= old->size) {
+                    break;
+                }
+                {
+                    int flag = old and old == list.WILDERNESS ? ENABLE_WILDERNESS_EXTEND : DISABLE_WILDERNESS_EXTEND;
+                    MallocMetaData* moved = list.allocateBlock(op.size, flag);
+                    if(moved == nullptr) {
+                        break;
+                    }
+                    if(old and moved != old) {
+                        list.freeBlock(old);
+                    }
+                    block = moved;
+                }
+                break;
+            default:
+                if(block) {
+                    list.freeBlock(block);
+                    block = nullptr;
+                }
+                break;
+        }
+        if(op.op != STRACE_FREE and block == nullptr) {
+            result.failed++;
+        }
+        live_bytes -= sizes[op.slot];
+        sizes[op.slot] = block ? op.size : 0;
+        live_bytes += sizes[op.slot];
+        size_t heap_bytes = list.total_bytes + list.total_blocks * sizeof(MallocMetaData);
+        if(heap_bytes > result.peak_heap_bytes) {
+            result.peak_heap_bytes = heap_bytes;
+            result.free_bytes_at_peak = list.num_free_bytes;
+            result.live_bytes_at_peak = live_bytes;
+        }
+    }
+    result.num_growths = list.num_sbrk_calls;
+    result.grown_bytes = list.reserved_region.used;
+    result.searches = list.placement.searches;
+    result.search_steps = list.placement.search_steps;
+    result.insert_steps = list.placement.insert_steps;
+    return result;
+}
+
+template<class List>
+void printSimulation(const char* name, const Replay& replay) {
+    SimResult result = simulate<List>(replay);
+    size_t num_ops = std::max(replay.ops.size(), (size_t)(1));
+    printf("%-32s %14zu %10.4f %10.4f %8zu %14zu %12.2f %12.2f %8zu\n", name, result.peak_heap_bytes,
+           /* Free share of the peak heap, and live bytes asked for against it */
+           result.peak_heap_bytes ? (double)(result.free_bytes_at_peak) / result.peak_heap_bytes : 0,
+           result.peak_heap_bytes ? (double)(result.live_bytes_at_peak) / result.peak_heap_bytes : 0,
+           result.num_growths, result.grown_bytes,
+           result.searches ? (double)(result.search_steps) / result.searches : 0,
+           (double)(result.insert_steps) / num_ops, result.failed);
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s <trace>\n", argv[0]);
+        return 2;
+    }
+    Replay replay;
+    if(not loadTrace(argv[1], replay)) {
+        fprintf(stderr, "%s: not a trace\n", argv[1]);
+        return 1;
+    }
+    printf("%zu ops, %zu skipped, %zu live objects at most\n", replay.ops.size(), replay.skipped, replay.num_slots);
+    printf("%-32s %14s %10s %10s %8s %14s %12s %12s %8s\n", "LAYOUT", "PEAK HEAP", "FREE/PEAK",
+           "LIVE/PEAK", "GROWTHS", "GROWN BYTES", "STEPS/SRCH", "INSERTS/OP", "FAILED");
+    printSimulation<BlockMetaDataList<Counted<BestFit>>>("BestFit", replay);
+    printSimulation<BlockMetaDataList<Counted<FirstFitAddressOrdered>>>("FirstFitAddressOrdered", replay);
+    printSimulation<BlockMetaDataList<Counted<NextFit>>>("NextFit", replay);
+    printSimulation<BlockMetaDataList<Counted<Lifo>>>("Lifo", replay);
+    printSimulation<BlockMetaDataList<Counted<BestFit>, MinRemainderSplit<128>>>("BestFit, MinRemainderSplit<128>",
+                                                                                 replay);
+    printSimulation<BlockMetaDataList<Counted<BestFit>, MinRemainderSplit<1>, 32>>("BestFit, 32 bins", replay);
+    printSimulation<BlockMetaDataList<Counted<BestFit>, MinRemainderSplit<1>, 1>>("BestFit, 1 bin", replay);
+    return 0;
+}